@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <QElapsedTimer>
+#include <QPaintEvent>
+#include <QPainter>
+
+#include "matrixview.h"
+
+MatrixView::MatrixView(QWidget* parent) : QWidget(parent)
+{
+    setAttribute(Qt::WA_OpaquePaintEvent); // Canvas covers whole widget, no background erase
+    setMinimumSize(cols * 4, rows * 4);
+}
+
+void MatrixView::rebuild()
+{
+    cell = std::max(4, std::min(width() / cols, height() / rows));
+    origin = QPoint((width() - cell * cols) / 2, (height() - cell * rows) / 2);
+
+    int diameter = cell * 22 / 25; // Same LED/gap proportion as 22 pixel LEDs on 25 pixel grid
+    int offset = (cell - diameter) / 2;
+    for(int br = 0; br <= max_br; ++br)
+    {
+        QImage& spr = sprites[br];
+        spr = QImage(cell, cell, QImage::Format_RGB32);
+        spr.fill(Qt::white);
+        QPainter p(&spr);
+        p.setRenderHint(QPainter::Antialiasing);
+        p.setPen(QColorConstants::Black);
+        p.setBrush(br ? QColor(255 * br / max_br, 0, 0) : QColorConstants::LightGray);
+        p.drawEllipse(offset, offset, diameter, diameter);
+    }
+
+    canvas = QImage(size(), QImage::Format_RGB32);
+    canvas.fill(Qt::white);
+    QPainter p(&canvas);
+    for(int y = 0; y < rows; ++y)
+        for(int x = 0; x < cols; ++x)
+            p.drawImage(led_rect(x, y).topLeft(), sprites[levels[y][x]]);
+}
+
+void MatrixView::show_pixels(const Pixels& pixs)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QRegion dirty;
+    QPainter p;
+    for(int y = 0; y < rows; ++y)
+    {
+        for(int x = 0; x < cols; ++x)
+        {
+            uint8_t br = uint8_t(pixs.get_br(x, y));
+            if (br == levels[y][x]) continue;
+            levels[y][x] = br;
+            if (canvas.isNull()) continue; // Not shown yet, 'rebuild' draws it
+            if (!p.isActive()) p.begin(&canvas);
+            p.drawImage(led_rect(x, y).topLeft(), sprites[br]);
+            dirty += led_rect(x, y);
+        }
+    }
+    if (p.isActive()) p.end();
+    if (!dirty.isEmpty()) update(dirty);
+
+    render_ns += timer.nsecsElapsed();
+}
+
+void MatrixView::paintEvent(QPaintEvent* event)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    QPainter p(this);
+    for(const QRect& r: event->region()) p.drawImage(r, canvas, r);
+
+    render_ns += timer.nsecsElapsed();
+}
+
+void MatrixView::resizeEvent(QResizeEvent*)
+{
+    rebuild();
+    update();
+}
+
+uint64_t MatrixView::take_render_time()
+{
+    uint64_t result = render_ns;
+    render_ns = 0;
+    return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <QImage>
+#include <QWidget>
+
+#include "../common/interface.h"
+
+/*
+    LED matrix view. LEDs are composed into one off-screen raster ('canvas', size of widget), only LEDs with changed
+    brightness are redrawn there and only their rectangles are repainted (blit from 'canvas').
+    Matrix is scaled to widget size, keeping aspect ratio.
+    Time spent here is shown in status bar ('take_render_time'). It was not compared with former QGraphicsScene view
+*/
+class MatrixView : public QWidget
+{
+public:
+    explicit MatrixView(QWidget* parent = nullptr);
+
+    void show_pixels(const Pixels& pixs);
+
+    uint64_t take_render_time(); // Time spent in composing and painting since last call, in ns
+
+protected:
+    virtual void paintEvent(QPaintEvent* event) override;
+    virtual void resizeEvent(QResizeEvent* event) override;
+
+private:
+    static constexpr int cols = 8;
+    static constexpr int rows = 16;
+
+    uint8_t levels[rows][cols] = {}; // Brightness drawn on 'canvas'
+    QImage canvas;
+    QImage sprites[max_br + 1];      // LED for each brightness, cell sized
+    QPoint origin;                   // Top left corner of LED grid
+    int cell = 25;                   // LED pitch
+    uint64_t render_ns = 0;
+
+    QRect led_rect(int x, int y) const {return QRect(origin.x() + x * cell, origin.y() + y * cell, cell, cell);}
+    void rebuild(); // Scale changed: recreate sprites and redraw all LEDs
+};
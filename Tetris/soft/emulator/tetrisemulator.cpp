@@ -1,6 +1,11 @@
+#include <algorithm>
 #include <QThread>
 
 #include "tetrisemulator.h"
+#include "../common/key_queue.h"
+#include "../common/trace.h"
+#include "../common/isr_stats.h"
+#include "../common/vscreen.h"
 
 static TetrisEmulator* root;
 
@@ -10,25 +15,27 @@ TetrisEmulator::TetrisEmulator(QWidget *parent)
     root = this;
     ui.setupUi(this);
 
-    for(int x=0; x<8; ++x)
-        for(int y=0; y<16; ++y)
-            field[x][y] = scene.addEllipse(QRect(x*25, y*25, 22, 22), QPen(QColorConstants::Black), QBrush(QColorConstants::LightGray));
-
-    ui.main_pane->setScene(&scene);
-    ui.main_pane->show();
-
     setFocusPolicy(Qt::StrongFocus);
     setFocus();
 
+    // Speed controls. Toolbar buttons don't take focus, so keys still go to game
+    auto group = new QActionGroup(this);
+    const char* names[] = {"1x", "10x", "Max", "Pause"};
+    const Qt::Key shortcuts[] = {Qt::Key_F1, Qt::Key_F2, Qt::Key_F3, Qt::Key_F4};
+    for(int i = 0; i < 4; ++i)
+    {
+        speed_actions[i] = ui.mainToolBar->addAction(names[i], [this, i]() {set_speed(Speed(i));});
+        speed_actions[i]->setCheckable(true);
+        speed_actions[i]->setShortcut(shortcuts[i]);
+        group->addAction(speed_actions[i]);
+    }
+    speed_actions[Speed_1x]->setChecked(true);
+    ui.mainToolBar->addAction("Step", this, &TetrisEmulator::step)->setShortcut(Qt::Key_F5);
+
     tmr.setTimerType(Qt::PreciseTimer);
-    tmr.callOnTimeout(
-        [this]() 
-        {
-            draw_pixels();
-            cv.notify_all();
-        }
-    );
+    tmr.callOnTimeout(this, &TetrisEmulator::tick);
     tmr.start(tick_time);
+    stats_timer.start();
 
     QThread::create([]() {entry();})->start();
 }
@@ -36,30 +43,65 @@ TetrisEmulator::TetrisEmulator(QWidget *parent)
 TetrisEmulator::~TetrisEmulator()
 {}
 
-void TetrisEmulator::draw_pixels()
+// Real time tick: grant frames to game. Backlog is limited to one tick worth of frames - if game can't keep up,
+// virtual time runs slower than requested
+void TetrisEmulator::tick()
 {
-    uint8_t* p1=pixs.br1;
-    uint8_t* p2=pixs.br2;
+    draw_pixels();
 
-    for (int y = 0; y < 16; ++y)
-    {
-        uint8_t px1 = *p1++;
-        uint8_t px2 = *p2++;
-        for (int x = 0; x < 8; ++x)
-        {
-            auto color = QColorConstants::LightGray;
-            switch ((px1 & 1) + (px2 & 1) * 2)
-            {
-                case 0: break;
-                case 1: color = QColor(255 / 3, 0, 0); break;
-                case 2: color = QColor(255*2 / 3, 0, 0); break;
-                case 3: color = QColor(255, 0, 0); break;
-            }
-            field[x][y]->setBrush(color);
-            px1 >>= 1;
-            px2 >>= 1;
-        }
-    }
+    QMutexLocker lock(&mtx);
+    uint32_t frames = speed == Speed_1x ? 1 : speed == Speed_10x ? 10 : 0;
+    if (!frames) return;
+    granted = std::min(granted, frame_count) + frames;
+    cv.notify_all();
+}
+
+void TetrisEmulator::set_speed(Speed new_speed)
+{
+    mtx.lock();
+    speed = new_speed;
+    granted = frame_count;
+    mtx.unlock();
+    cv.notify_all();
+    speed_actions[new_speed]->setChecked(true);
+    update_status();
+}
+
+// Run one frame (pauses game if it is running)
+void TetrisEmulator::step()
+{
+    if (speed != Speed_Pause) set_speed(Speed_Pause);
+    mtx.lock();
+    granted = frame_count + 1;
+    mtx.unlock();
+    cv.notify_all();
+    update_status();
+}
+
+void TetrisEmulator::update_status()
+{
+    static const char* names[] = {"1x", "10x", "Max", "Pause"};
+    mtx.lock();
+    uint32_t frame = frame_count;
+    mtx.unlock();
+    ui.statusBar->showMessage(QString("%1 | frame %2 (%3 s) | %4").arg(names[speed]).arg(frame)
+                              .arg(frame * tick_time / 1000.0, 0, 'f', 2).arg(render_stats));
+}
+
+void TetrisEmulator::draw_pixels()
+{
+    mtx.lock();
+    Pixels picture = shown;
+    mtx.unlock();
+    ui.main_pane->show_pixels(picture);
+
+    // Render cost (composition + repaint) per frame, averaged over a second
+    ++stats_frames;
+    if (stats_timer.elapsed() < 1000) return;
+    double us = ui.main_pane->take_render_time() / 1000.0 / stats_frames;
+    render_stats = QString("Render: %1 us/frame, %2 fps").arg(us, 0, 'f', 1).arg(stats_frames * 1000 / stats_timer.restart());
+    stats_frames = 0;
+    update_status();
 }
 
 static uint8_t key2key(int key)
@@ -86,7 +128,8 @@ void TetrisEmulator::keyPressEvent(QKeyEvent* event)
     if (~last_keys & new_key) // Press some
     {
         last_keys |= new_key;
-        active_keys |= new_key;
+        QMutexLocker lock(&mtx);
+        key_queue.put({uint16_t(frame_count), new_key, true});
     }
 }
 
@@ -94,23 +137,62 @@ void TetrisEmulator::keyReleaseEvent(QKeyEvent* event)
 {
     if (event->isAutoRepeat()) return;
     uint8_t new_key = key2key(event->key());
+    if (!(last_keys & new_key)) return;
     last_keys &= ~new_key;
-    active_keys &= ~new_key;
+    QMutexLocker lock(&mtx);
+    key_queue.put({uint16_t(frame_count), new_key, false});
 }
 
-uint8_t TetrisEmulator::read_key()
+void TetrisEmulator::present()
 {
-    mtx.lock();
-    cv.wait(&mtx);
-    uint8_t result = active_keys;
-    mtx.unlock();
-    return result;
+    if (vscreen_shown()) return; // Viewport of 'vscreen' is shown at frame boundary (see 'wait_vsync')
+    QMutexLocker lock(&mtx);
+    shown = pixs;
+}
+
+// Lockstep with virtual time: exactly one frame passes per call
+uint32_t TetrisEmulator::wait_vsync()
+{
+    QMutexLocker lock(&mtx);
+    while (speed != Speed_Max && frame_count >= granted) cv.wait(&mtx);
+    ++frame_count;
+    if (speed == Speed_Max) granted = frame_count;
+    if (vscreen_shown()) vscreen_frame(shown);
+    return 1;
+}
+
+void present() {root->present();}
+uint32_t wait_vsync() {return root->wait_vsync();}
+
+// Nanoseconds
+uint32_t get_cycles()
+{
+    static QElapsedTimer timer;
+    if (!timer.isValid()) timer.start();
+    return uint32_t(timer.nsecsElapsed());
 }
+const uint32_t cycles_per_us = 1000;
 
-uint8_t read_key() {return root->read_key();}
-void clr_keys(uint8_t keys) {root->clr_keys(keys);}
+// No interrupts in emulator
+const IsrStats* get_isr_stats(int) {return nullptr;}
 
-uint32_t get_random()
+uint32_t get_entropy()
 {
     return QRandomGenerator::global()->generate();
 }
+
+// Called from game thread: message box is shown by GUI thread, game thread waits for it
+void fatal_error(const char* what)
+{
+    QMetaObject::invokeMethod(root, [what]() {QMessageBox::critical(root, "Fatal error", what);},
+        Qt::BlockingQueuedConnection);
+    abort();
+}
+
+// Save trace to 'trace_<N>.rwt' in current directory (for replay by headless build)
+void trace_save(const uint8_t* data, uint32_t size)
+{
+    static int counter = 0;
+    QFile file(QString("trace_%1.rwt").arg(counter++));
+    if (file.open(QIODevice::WriteOnly)) file.write((const char*)data, size);
+}
@@ -2,11 +2,11 @@
 
 #include <QtWidgets>
 #include <QtWidgets/QMainWindow>
-#include <QGraphicsEllipseItem>
 #include <QWaitCondition>
 #include <QTimer>
 
 #include "ui_tetrisemulator.h"
+#include "matrixview.h"
 
 #include "../common/interface.h"
 
@@ -14,29 +14,48 @@ class TetrisEmulator : public QMainWindow
 {
     Q_OBJECT
 
-    QGraphicsEllipseItem* field[8][16];
-
-    QGraphicsScene scene;
+public:
+    // Virtual time speed: game frames per 'tick_time' of real time
+    enum Speed {Speed_1x, Speed_10x, Speed_Max, Speed_Pause};
 
+private:
     uint8_t last_keys = 0;
-    uint8_t active_keys = 0;
+
+    // Virtual time (protected by 'mtx'). Game runs frame by frame: 'wait_vsync' waits until 'frame_count' is below
+    // 'granted', timer grants frames according to 'speed'. Ticks are counted, so slow frame delays game, but never
+    // makes it skip frames.
+    uint32_t frame_count = 0; // Frames started by game. Timestamp for key events
+    uint32_t granted = 0;     // Frames game is allowed to start
+    Speed speed = Speed_1x;
+
+    Pixels shown; // Last presented picture (protected by 'mtx')
 
     QWaitCondition cv;
     QMutex mtx;
     QTimer tmr;
 
+    QElapsedTimer stats_timer; // Render cost report period
+    uint32_t stats_frames = 0;
+    QString render_stats;
+
+    QAction* speed_actions[4];
+
     virtual void keyPressEvent(QKeyEvent* event) override;
     virtual void keyReleaseEvent(QKeyEvent* event) override;
 
     void draw_pixels();
+    void tick();
+    void set_speed(Speed new_speed);
+    void step();
+    void update_status();
 
     int x=0, y=0;
 public:
     TetrisEmulator(QWidget *parent = nullptr);
     ~TetrisEmulator();
 
-    uint8_t read_key();
-    void clr_keys(uint8_t keys) {active_keys &= ~keys;}
+    void present();
+    uint32_t wait_vsync();
 
 private:
     Ui::TetrisEmulatorClass ui;
@@ -0,0 +1,106 @@
+/*
+    Worst-case timing of Snake free cell sampling.
+    For boards with different number of free cells compares previous rejection sampling (probe random cells
+    via 'Pixels::get_color' until free one found) with bitboard sampling (popcount + select of n-th free cell).
+    Checks that selected cells are free and that all free cells are selected.
+
+    Built as 'bench_snake' target of host CMake project (see CMakeLists.txt)
+*/
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <vector>
+
+#include "interface.h"
+
+static constexpr int samples = 200000;
+
+using Clock = std::chrono::steady_clock;
+
+static double ns(Clock::duration d) {return std::chrono::duration<double, std::nano>(d).count();}
+
+// Previous algorithm. Returns number of probes
+static int reject_sample(std::mt19937& rnd, int& pos)
+{
+    for (int probes = 1;; ++probes)
+    {
+        int x = rnd() & 7;
+        int y = rnd() & 15;
+        if (pixs.get_color(x, y)) continue;
+        pos = x + y*8;
+        return probes;
+    }
+}
+
+static int bitboard_sample(std::mt19937& rnd, const Bitboard& occupied)
+{
+    Bitboard free;
+    for (int k = 0; k < 4; ++k) free.w[k] = ~occupied.w[k];
+    int total = free.count();
+    return free.select(rnd() % total);
+}
+
+int main()
+{
+    std::mt19937 rnd(1);
+    bool ok = true;
+    printf("Time per sample includes clock overhead (~20-50 ns)\n");
+    printf("free   rejection: probes avg/max  ns avg/p99       bitboard: ns avg/p99\n");
+    for (int free_cells: {128, 64, 32, 16, 8, 4, 2, 1})
+    {
+        // Random board with 'free_cells' free cells
+        int cells[128];
+        for (int i = 0; i < 128; ++i) cells[i] = i;
+        std::shuffle(cells, cells+128, rnd);
+        pixs.clear();
+        Bitboard occupied = {};
+        for (int i = free_cells; i < 128; ++i)
+        {
+            pixs.set_color(cells[i] & 7, cells[i] >> 3, 2);
+            occupied.set(cells[i] & 7, cells[i] >> 3);
+        }
+
+        uint64_t total_probes = 0;
+        int max_probes = 0;
+        std::vector<double> old_ns(samples), new_ns(samples);
+        bool seen[128] = {};
+        for (int i = 0; i < samples; ++i)
+        {
+            int pos;
+            auto t0 = Clock::now();
+            int probes = reject_sample(rnd, pos);
+            auto t1 = Clock::now();
+            int new_pos = bitboard_sample(rnd, occupied);
+            auto t2 = Clock::now();
+
+            total_probes += probes;
+            max_probes = std::max(max_probes, probes);
+            old_ns[i] = ns(t1 - t0);
+            new_ns[i] = ns(t2 - t1);
+            if (new_pos < 0 || occupied.get(new_pos & 7, new_pos >> 3)) ok = false;
+            else seen[new_pos] = true;
+        }
+        for (int i = 0; i < free_cells; ++i) if (!seen[cells[i]]) ok = false;
+
+        // Max is spoiled by preemptions of host OS, so 99 percentile is used as worst case
+        auto stat = [](std::vector<double>& v, double& avg, double& worst) {
+            avg = 0;
+            for (auto t: v) avg += t;
+            avg /= v.size();
+            std::sort(v.begin(), v.end());
+            worst = v[v.size() * 99 / 100];
+        };
+        double old_avg, old_worst, new_avg, new_worst;
+        stat(old_ns, old_avg, old_worst);
+        stat(new_ns, new_avg, new_worst);
+        printf("%4d   %8.1f/%-6d %10.0f/%-10.0f %10.0f/%-6.0f\n", free_cells, double(total_probes) / samples, max_probes,
+            old_avg, old_worst, new_avg, new_worst);
+    }
+    if (!ok)
+    {
+        printf("ERROR: Bitboard sampler selected occupied cell or missed free one\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+/*
+    Host benchmark of Sprite::place.
+    Compares current (bitboard) implementation with previous one (row by row processing), kept here as 'LegacySprite'.
+    Both run same sequence of Tetris-like moves on same boards; results are checked to be identical.
+
+    Built as 'bench_sprite' target of host CMake project (see CMakeLists.txt)
+*/
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdio.h>
+#include <time.h>
+
+#include "sprite.h"
+#include "spr_defs.h"
+
+// Previous implementation. Sprite pixels were packed row by row ('width' bits per row)
+class LegacySprite {
+    int base_index;
+    int index;
+    int spr_x=0, spr_y=0, spr_rotation=0;
+    SprColor spr_color = SC_Off;
+
+    const SpriteDef& spr() const { return sprites[index]; }
+    const SpriteDef& spr2() const { return sprites[index+1]; }
+    const SpriteDef& bspr() const { return sprites[base_index]; }
+
+    static uint32_t legacy_pixels[256]; // Sprite pixels in old format
+
+    static uint32_t pixels(const SpriteDef& S) {return legacy_pixels[&S - sprites];}
+
+    uint32_t combined_spr_mask() const {
+        uint32_t spr_mask = pixels(spr());
+        if (spr().is_gs) spr_mask |= pixels(spr2());
+        return spr_mask;
+    }
+
+    using Functor = int(int y, uint8_t, uint8_t d1, uint8_t d2);
+
+    int process(uint32_t spr1_data, uint32_t spr2_data, Functor func)
+    {
+        const SpriteDef& S = spr();
+        int y = spr_y - S.height / 2;
+        int result = 0;
+        uint8_t mask = (1 << S.width) - 1;
+        uint8_t shift = spr_x - S.width / 2;
+        uint8_t data_mask = mask << shift;
+        for (int row = 0; row < S.height; ++row, ++y)
+        {
+            result |= func(y, data_mask, (spr1_data & mask) << shift, (spr2_data & mask) << shift);
+            spr1_data >>= S.width;
+            spr2_data >>= S.width;
+        }
+        return result;
+    }
+
+    bool check_collitions()
+    {
+        const SpriteDef& S = spr();
+        if (spr_x < int(S.width/2) || spr_y < int(S.height/2) || spr_x+S.width-S.width/2 > 8 || spr_y + S.height - S.height/2 > 16) return true;
+        uint32_t spr_mask = combined_spr_mask();
+
+        return process(spr_mask, spr_mask, [](int y, uint8_t, uint8_t d1, uint8_t d2) ->int {
+            return pixs.row_mask(y) & (d1|d2);
+        }) != 0;
+    }
+
+    void clear_sprite()
+    {
+        uint32_t spr_mask = combined_spr_mask();
+        process(spr_mask, spr_mask, [](int y, uint8_t, uint8_t d1, uint8_t) ->int {
+            pixs.set_mask(y, d1, 0);
+            return 0;
+        });
+    }
+
+    void draw_sprite(SprColor color)
+    {
+        const SpriteDef& S = spr();
+        if (color == SC_On && !S.is_gs) color = SC_Full;
+        uint32_t data1=0, data2=0;
+        switch (color)
+        {
+            case SC_1: data1 = pixels(S); break;
+            case SC_2: data2 = pixels(S); break;
+            case SC_Full: data1 = data2 = pixels(S); break;
+            case SC_On: data1 = pixels(S); data2 = pixels(spr2()); break;
+            default: break;
+        }
+        process(data1, data2, [](int y, uint8_t mask, uint8_t d1, uint8_t d2) ->int {
+            mask &= d1 | d2;
+            for (int p = 0; p < bitplanes; ++p)
+            {
+                pixs.br[p][y] = (pixs.br[p][y] & ~mask) | Pixels::plane_bits(p, d1, d2);
+            }
+            return 0;
+        });
+    }
+
+    void set_rotation(int new_rot)
+    {
+        const SpriteDef& S = bspr();
+        int max_sprites = S.group_size+1;
+        if (new_rot < 0) new_rot += max_sprites;
+        new_rot %= max_sprites;
+        spr_rotation = new_rot;
+        index = base_index + (S.is_gs ? spr_rotation*2 : spr_rotation);
+    }
+
+public:
+    // Convert byte lanes format of used sprites to row by row one
+    static void init()
+    {
+        for(int i = 0; i < total_tetris_figures; ++i)
+        {
+            const SpriteDef* S = sprites + tetris_figures[i];
+            int count = (S->group_size + 1) * (S->is_gs ? 2 : 1);
+            for(; count--; ++S)
+            {
+                uint32_t result = 0;
+                for(int y = S->height; y--;) result = (result << S->width) | ((S->pixels >> (y*8)) & ((1 << S->width) - 1));
+                legacy_pixels[S - sprites] = result;
+            }
+        }
+    }
+
+    LegacySprite(int sprite_index) : base_index(sprite_index), index(sprite_index) {}
+
+    const SpriteDef& spr_def() const { return spr(); }
+
+    bool place(int x, int y, int rotation, SprColor color = SC_On)
+    {
+        int sv_x = spr_x, sv_y = spr_y, sv_rot = spr_rotation;
+        if (color == SC_NoChange) color = spr_color;
+        if (spr_color) clear_sprite();
+        spr_x = x; spr_y = y;
+        set_rotation(rotation);
+        if (!color) { spr_color = SC_Off; return true; }
+        bool collition = check_collitions();
+        if (collition)
+        {
+            spr_x = sv_x; spr_y = sv_y; set_rotation(sv_rot);
+            color = spr_color;
+        }
+        if (color) draw_sprite(color);
+        spr_color = color;
+        return !collition;
+    }
+    bool move(int dx, int dy, int drot, SprColor color = SC_NoChange)
+    {
+        return place(spr_x+dx, spr_y+dy, spr_rotation+drot, color);
+    }
+};
+
+uint32_t LegacySprite::legacy_pixels[256];
+
+// Process CPU time, less affected by other load than wall clock
+static std::chrono::duration<double> clock_now()
+{
+    return std::chrono::duration<double>(double(clock()) / CLOCKS_PER_SEC);
+}
+
+static constexpr int total_games = 200000;
+
+struct Move {int8_t dx, dy, drot;};
+
+// Random moves, prepared before benchmark so only 'place' and board setup are timed
+static std::vector<Move> moves;
+static std::vector<uint8_t> boards; // Random rows for bottom half of board (8 rows by 2 bytes) + figure index for each game
+
+static void init_script()
+{
+    std::mt19937 rnd(1);
+    static const Move variants[4] = {{-1, 0, 0}, {1, 0, 0}, {0, 0, 1}, {0, 1, 0}};
+    moves.resize(1 << 20);
+    for(auto& m: moves) m = variants[rnd() % 4];
+    boards.resize(total_games * 17);
+    for(auto& b: boards) b = rnd();
+}
+
+// Drop random figures on random boards with random moves. Returns checksum of all boards and 'place' results
+template<typename Spr>
+static uint32_t run(uint32_t& places)
+{
+    uint32_t checksum = 0;
+    size_t move_idx = 0;
+    const uint8_t* board = boards.data();
+    places = 0;
+    for(int game = 0; game < total_games; ++game, board += 17)
+    {
+        pixs.clear();
+        for(int y = 8; y < 16; ++y) pixs.set_row(y, board[y-8], board[y]);
+        Spr figure = tetris_figures[board[16] % total_tetris_figures];
+        bool ok = figure.place(4, figure.spr_def().height/2, 0);
+        ++places;
+        while (ok)
+        {
+            const Move& m = moves[move_idx++ & (moves.size() - 1)]; // Size is power of 2
+            ok = figure.move(m.dx, m.dy, m.drot) || !m.dy;
+            checksum += ok;
+            ++places;
+        }
+        for(auto& plane: pixs.br)
+            for(auto v: plane) checksum = checksum * 31 + v;
+    }
+    return checksum;
+}
+
+// Adapter to give 'Sprite' same interface as 'LegacySprite'
+class NewSprite : public Sprite {
+public:
+    NewSprite(int sprite_index) : Sprite(sprite_index) {}
+    const SpriteDef& spr_def() const { return spr(); }
+};
+
+template<typename Spr>
+static void bench(const char* name, uint32_t& checksum)
+{
+    uint32_t places;
+    double best = 1e9;
+    for(int i = 0; i < 5; ++i) // Best of 5 runs
+    {
+        auto start = clock_now();
+        checksum = run<Spr>(places);
+        auto elapsed = clock_now() - start;
+        if (elapsed.count() < best) best = elapsed.count();
+    }
+    printf("%-8s %u places in %.3f s: %.1f M places/s, %.1f ns/place (checksum %08X)\n", name, places, best, places / best / 1e6, best * 1e9 / places, checksum);
+}
+
+int main()
+{
+    uint32_t legacy, current;
+    LegacySprite::init();
+    init_script();
+    bench<LegacySprite>("legacy", legacy);
+    bench<NewSprite>("bitboard", current);
+    if (legacy != current)
+    {
+        printf("ERROR: Results are different\n");
+        return 1;
+    }
+    return 0;
+}
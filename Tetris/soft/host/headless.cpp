@@ -0,0 +1,116 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+
+#include "headless.h"
+#include "key_queue.h"
+#include "isr_stats.h"
+#include "vscreen.h"
+
+static INSTANCE_LOCAL uint32_t frame;
+static INSTANCE_LOCAL uint32_t max_frames;
+static INSTANCE_LOCAL KeySource key_source;
+static INSTANCE_LOCAL uint8_t cur_keys;
+static INSTANCE_LOCAL uint32_t rnd_state;
+static INSTANCE_LOCAL uint32_t checksum;
+static INSTANCE_LOCAL std::vector<uint8_t> last_trace;
+static INSTANCE_LOCAL std::vector<uint32_t>* frame_costs;
+static INSTANCE_LOCAL uint32_t frame_start; // 'get_cycles' at return from 'wait_vsync'
+
+void headless_reset(uint32_t seed, KeySource keys, uint32_t frames_limit)
+{
+    restore_keys(0);
+    vscreen_hide();
+    frame = 0;
+    max_frames = frames_limit;
+    key_source = std::move(keys);
+    cur_keys = 0;
+    rnd_state = seed ? seed : 1;
+    seed_random(seed);
+    checksum = 0;
+}
+
+uint32_t headless_frame() {return frame;}
+uint32_t headless_checksum() {return checksum;}
+const std::vector<uint8_t>& headless_trace() {return last_trace;}
+void headless_frame_costs(std::vector<uint32_t>* costs) {frame_costs = costs;}
+
+// Random player: every 'period' frames presses one random key from 'keys' for one frame
+KeySource random_player(uint32_t seed, uint8_t keys, int period)
+{
+    uint8_t key_list[8];
+    int total = 0;
+    for(uint8_t key = 1; key; key <<= 1) if (keys & key) key_list[total++] = key;
+    return [rnd = std::mt19937(seed), key_list, total, period](uint32_t frame) mutable -> uint8_t {
+        if (frame % period) return 0;
+        return key_list[rnd() % total];
+    };
+}
+
+void trace_save(const uint8_t* data, uint32_t size)
+{
+    last_trace.assign(data, data + size);
+}
+
+// xorshift32
+uint32_t get_entropy()
+{
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 17;
+    rnd_state ^= rnd_state << 5;
+    return rnd_state;
+}
+
+// FNV-1a of picture
+static uint32_t picture_hash(const Pixels& picture)
+{
+    uint32_t hash = 2166136261u;
+    for(auto& plane: picture.br)
+        for(auto v: plane) hash = (hash ^ v) * 16777619u;
+    return hash;
+}
+
+// While virtual screen is shown its viewport window is hashed at frame boundary instead (see 'wait_vsync')
+void present()
+{
+    if (!vscreen_shown()) checksum = checksum * 31 + picture_hash(pixs);
+    if (frame_costs && frame) frame_costs->push_back(get_cycles() - frame_start);
+}
+
+uint32_t wait_vsync()
+{
+    ++frame;
+    if (max_frames && frame >= max_frames) throw FrameLimit();
+    if (vscreen_shown())
+    {
+        static INSTANCE_LOCAL Pixels window;
+        vscreen_frame(window);
+        checksum = checksum * 31 + picture_hash(window);
+    }
+    uint8_t keys = key_source ? key_source(frame) : 0;
+    uint8_t changed = cur_keys ^ keys;
+    cur_keys = keys;
+    for(uint8_t key = 1; key; key <<= 1)
+    {
+        if (changed & key) key_queue.put({uint16_t(frame), key, (keys & key) != 0});
+    }
+    if (frame_costs) frame_start = get_cycles();
+    return 1;
+}
+
+void fatal_error(const char* what)
+{
+    fprintf(stderr, "Fatal error: %s\n", what);
+    abort();
+}
+
+// Nanoseconds of real time
+uint32_t get_cycles()
+{
+    return uint32_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+const uint32_t cycles_per_us = 1000;
+
+// No interrupts in headless build
+const IsrStats* get_isr_stats(int) {return nullptr;}
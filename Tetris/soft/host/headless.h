@@ -0,0 +1,34 @@
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include "interface.h"
+
+/*
+    Headless platform.
+    No display and no real time: every 'wait_vsync' call is one frame of virtual time (tick_time ms), returned immediately.
+    Keys are taken from script function, 'get_entropy' is deterministic (depends on seed only).
+    All state is per thread (common code is built with INSTANCE_PER_THREAD), so every thread runs independent instance
+*/
+
+// Keys source. Called once per frame with frame number, returns state of keys (bitset of 'Key')
+using KeySource = std::function<uint8_t(uint32_t frame)>;
+
+// Random player: every 'period' frames presses one random key from 'keys' for one frame
+KeySource random_player(uint32_t seed, uint8_t keys, int period = 4);
+
+// Thrown from 'wait_vsync' when frame limit reached
+struct FrameLimit {};
+
+// Start new run: reseed entropy and random, drop pending keys, reset frame counter.
+// 'max_frames' - frame limit (0 - no limit)
+void headless_reset(uint32_t seed, KeySource keys, uint32_t max_frames = 0);
+
+uint32_t headless_frame();    // Frames passed since reset (virtual time is headless_frame()*tick_time ms)
+uint32_t headless_checksum(); // Checksum of all pictures presented since reset
+const std::vector<uint8_t>& headless_trace(); // Last saved trace (see 'trace.h')
+
+// Collect cost of every frame (ns of real time from frame boundary to next 'present') to 'costs' (nullptr - stop).
+// Kept over 'headless_reset'
+void headless_frame_costs(std::vector<uint32_t>* costs);
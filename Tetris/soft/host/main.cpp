@@ -0,0 +1,198 @@
+/*
+    Run many simulated games on headless platform with random player as fast as CPU allows.
+    Prints game statistics, speed and checksum of all presented pictures (for regression checks).
+
+    Usage:
+      tetris_headless <tetris|snake|invation|menu> [games=1000] [seed=1]
+        'menu' runs main entry (menu + games) for 'games' * 1000 frames
+      tetris_headless record <tetris|snake|invation> <file> [seed=1]
+        Play one game by random player and save its input trace
+      tetris_headless replay <file>...
+        Replay traces (recorded here, by emulator or on device), check that game ends at recorded frame
+      tetris_headless timeline <tetris|snake|invation|menu> [seed=1]
+        Play one game (or 1000 frames of menu) by random player and print its timeline (see 'timeline.h'):
+        tetris_headless timeline tetris | python3 ../scripts/timeline2json.py - > tetris.json
+*/
+#include <chrono>
+#include <fstream>
+#include <iterator>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "headless.h"
+#include "game.h"
+#include "trace.h"
+#include "timeline.h"
+
+static constexpr uint32_t max_game_frames = 1000000; // Safety limit for single game
+
+struct PlayerSetup {
+    const char* name; // Game name in registry ('games') or "menu" for whole menu
+    uint8_t keys;     // Keys used by random player
+    int period;       // Frames between presses of random player
+    int game;         // Index in 'games' or -1 for whole menu
+};
+
+// Tetris player is slow: any move of landed figure restarts its settle down countdown (133 frames on level 1)
+static PlayerSetup players[] = {
+    {"tetris", K_Left|K_Right|K_Up|K_Down, 100, -1},
+    {"snake", K_Left|K_Right|K_Up|K_Down, 4, -1},
+    {"invation", K_Left|K_Right|K_Up|K_Hit, 4, -1},
+    {"menu", K_Left|K_Right|K_Up|K_Down|K_Hit|K_1|K_2, 4, -1},
+};
+
+static const PlayerSetup* find_game(const char* name)
+{
+    for(auto& p: players)
+    {
+        if (strcmp(name, p.name)) continue;
+        p.game = -1;
+        for(int i = 0; i < total_games; ++i) if (!strcmp(name, games[i].name)) p.game = i;
+        return &p;
+    }
+    return nullptr;
+}
+
+// Run single game (or menu) till its end or frame limit. Returns false if limit reached
+static bool play(int game)
+{
+    pixs.clear();
+    try
+    {
+        if (game < 0)
+        {
+            entry();
+        }
+        else
+        {
+            trace_begin(game);
+            run_game(game);
+            trace_end();
+        }
+    }
+    catch (FrameLimit&)
+    {
+        return false;
+    }
+    return true;
+}
+
+static int run_many(const PlayerSetup& game, int total_games, uint32_t seed)
+{
+    uint64_t frames = 0;
+    uint32_t min_frames = -1, max_frames = 0, aborted = 0, checksum = 0;
+    bool is_menu = game.game < 0;
+    auto start = std::chrono::steady_clock::now();
+    for(int i = 0; i < total_games; ++i)
+    {
+        headless_reset(seed + i, random_player(seed + i, game.keys, game.period), is_menu ? 1000 : max_game_frames);
+        if (!play(game.game) && !is_menu) ++aborted;
+        uint32_t f = headless_frame();
+        frames += f;
+        if (f < min_frames) min_frames = f;
+        if (f > max_frames) max_frames = f;
+        checksum = checksum * 31 + headless_checksum();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    printf("%s: %d games (%u aborted), frames per game min/avg/max %u/%.1f/%u\n", game.name, total_games, aborted,
+        min_frames, double(frames) / total_games, max_frames);
+    printf("%llu frames in %.3f s: %.0f games/s, %.0f frames/s (x%.0f of real time)\n", (unsigned long long)frames, elapsed.count(),
+        total_games / elapsed.count(), frames / elapsed.count(), frames * tick_time / 1000.0 / elapsed.count());
+    if (!is_menu)
+    {
+        const FrameStats& s = game_stats[game.game];
+        printf("Frame time (update + render) min/avg/max %.2f/%.2f/%.2f us, %u catch up updates\n",
+            double(s.min) / cycles_per_us, double(s.avg()) / cycles_per_us, double(s.max) / cycles_per_us, s.missed);
+    }
+    printf("Checksum: %08X\n", checksum);
+    return 0;
+}
+
+static int record(const PlayerSetup& game, const char* file_name, uint32_t seed)
+{
+    if (game.game < 0) {printf("Only single game can be recorded\n"); return 1;}
+    headless_reset(seed, random_player(seed, game.keys, game.period), max_game_frames);
+    if (!play(game.game)) {printf("Game does not finish\n"); return 1;}
+    auto& trace = headless_trace();
+    std::ofstream(file_name, std::ios::binary).write((const char*)trace.data(), trace.size());
+    printf("%s: %u frames, %u bytes of trace, checksum %08X\n", file_name, headless_frame(), unsigned(trace.size()), headless_checksum());
+    return 0;
+}
+
+static int timeline(const PlayerSetup& game, uint32_t seed)
+{
+    headless_reset(seed, random_player(seed, game.keys, game.period), game.game < 0 ? 1000 : max_game_frames);
+    timeline_clear();
+    play(game.game);
+    timeline_print();
+    return 0;
+}
+
+static int replay(const char* file_name)
+{
+    std::ifstream f(file_name, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    headless_reset(1, nullptr, max_game_frames);
+    pixs.clear();
+    int game = trace_replay(data.data(), data.size());
+    if (game < 0) {printf("%s: Not a trace\n", file_name); return 1;}
+    uint32_t expected = trace_total_frames();
+
+    auto start = std::chrono::steady_clock::now();
+    bool finished = true;
+    try
+    {
+        run_game(game);
+    }
+    catch (FrameLimit&)
+    {
+        finished = false;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    uint32_t frames = trace_frame();
+    trace_end();
+
+    bool ok = finished && (!expected || frames == expected);
+    printf("%s: game %d, %u frames (recorded %u) %s, checksum %08X, %.1f us/frame\n", file_name, game, frames, expected,
+        !ok ? "MISMATCH" : expected ? "OK" : "(truncated trace)", headless_checksum(), elapsed.count() * 1e6 / frames);
+    return ok ? 0 : 1;
+}
+
+static int usage(const char* name)
+{
+    printf("Usage:\n"
+           "  %s <tetris|snake|invation|menu> [games=1000] [seed=1]\n"
+           "  %s record <tetris|snake|invation> <file> [seed=1]\n"
+           "  %s replay <file>...\n"
+           "  %s timeline <tetris|snake|invation|menu> [seed=1]\n", name, name, name, name);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) return usage(argv[0]);
+    if (!strcmp(argv[1], "replay"))
+    {
+        int result = 0;
+        for(int i = 2; i < argc; ++i) result |= replay(argv[i]);
+        return result;
+    }
+    if (!strcmp(argv[1], "record"))
+    {
+        const PlayerSetup* game = argc > 3 ? find_game(argv[2]) : nullptr;
+        if (!game) return usage(argv[0]);
+        return record(*game, argv[3], argc > 4 ? atoi(argv[4]) : 1);
+    }
+    if (!strcmp(argv[1], "timeline"))
+    {
+        const PlayerSetup* game = argc > 2 ? find_game(argv[2]) : nullptr;
+        if (!game) return usage(argv[0]);
+        return timeline(*game, argc > 3 ? atoi(argv[3]) : 1);
+    }
+    const PlayerSetup* game = find_game(argv[1]);
+    if (!game) return usage(argv[0]);
+    return run_many(*game, argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 1);
+}
@@ -0,0 +1,281 @@
+/*
+    Tournament of bots: play many games on all host cores. Every thread runs independent instance of common code
+    (its state is thread local, see INSTANCE_LOCAL in 'interface.h'), games are handed out to threads one by one.
+    Prints speed, distribution of scores and real time cost of frames (update + render, see 'headless_frame_costs').
+    Results do not depend on number of threads: game N is always played with seed 'seed'+N.
+    Games longer than 'time_limit' are stopped by quit key (score is counted), so unbeatable bots finish too.
+
+    Usage:
+      tournament <tetris|snake|invation> [policy=random] [games=1000] [threads=all cores] [seed=1]
+      tournament list
+        Print available policies
+*/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+#include "headless.h"
+#include "game.h"
+#include "arena.h"
+
+static constexpr uint32_t time_limit = 200000;       // Frames (50 minutes) till game is stopped by quit key
+static constexpr uint32_t max_game_frames = 1000000; // Safety limit for single game (game ignores quit key)
+
+struct QuitKey {
+    const char* game;
+    uint8_t key;
+};
+
+static const QuitKey quit_keys[] = {
+    {"tetris", K_3},
+    {"snake", K_3},
+    {"invation", K_1},
+};
+
+// Bot policy. Bots may look at 'pixs' - picture of last frame (keys are asked for right after it was presented)
+struct Policy {
+    const char* game;   // Name in 'games' registry
+    const char* name;
+    const char* description;
+    KeySource (*create)(uint32_t seed); // nullptr - game autoplayer ('GameInfo::create_bot', same as attract mode)
+};
+
+// Invation hunter: keeps platform (middle of 3 lit pixels of bottom row) under nearest of lowest spaceships
+// (dim pixels, bullets are bright) and fires when aligned. Moves by K_2/K_3 and presses every other frame,
+// because game releases keys after use
+static KeySource invation_hunter(uint32_t)
+{
+    return [](uint32_t frame) -> uint8_t {
+        if (frame & 1) return 0;
+        uint8_t platform = pixs.row_mask(15);
+        if (!platform) return 0;
+        int pos = 0;
+        while (!((platform >> pos) & 1)) ++pos;
+        ++pos;
+        for (int y = 13; y >= 0; --y)
+        {
+            int target = -1;
+            for (int x = 0; x < 8; ++x)
+            {
+                if (pixs.get_color(x, y) != 1) continue;
+                if (target < 0 || abs(x - pos) < abs(target - pos)) target = x;
+            }
+            if (target < 0) continue;
+            target = std::min(std::max(target, 1), 6);
+            if (target < pos) return K_2;
+            if (target > pos) return K_3;
+            return K_Hit;
+        }
+        return 0;
+    };
+}
+
+// Random players use the same keys and periods as 'tetris_headless'
+static const Policy policies[] = {
+    {"tetris", "random", "random key of arrows every 100 frames",
+        [](uint32_t seed) {return random_player(seed, K_Left|K_Right|K_Up|K_Down, 100);}},
+    {"tetris", "bot", "autoplayer: search of best placement of every figure", nullptr},
+    {"snake", "random", "random arrow every 4 frames",
+        [](uint32_t seed) {return random_player(seed, K_Left|K_Right|K_Up|K_Down, 4);}},
+    {"snake", "bot", "autoplayer: BFS to food with flood fill safety check", nullptr},
+    {"invation", "random", "random of left, right, up, hit every 4 frames",
+        [](uint32_t seed) {return random_player(seed, K_Left|K_Right|K_Up|K_Hit, 4);}},
+    {"invation", "hunter", "aim at lowest spaceship and fire", invation_hunter},
+};
+
+// Histogram of frame costs: 'step' ns buckets, last one collects everything above
+struct CostHistogram {
+    static constexpr uint32_t step = 10;
+    static constexpr uint32_t buckets = 100000;
+
+    std::vector<uint64_t> counts = std::vector<uint64_t>(buckets);
+    uint64_t total = 0;
+    uint32_t max = 0;
+
+    void add(const std::vector<uint32_t>& costs)
+    {
+        for(uint32_t ns: costs)
+        {
+            ++counts[std::min(ns / step, buckets - 1)];
+            max = std::max(max, ns);
+        }
+        total += costs.size();
+    }
+    void add(const CostHistogram& other)
+    {
+        for(uint32_t i = 0; i < buckets; ++i) counts[i] += other.counts[i];
+        total += other.total;
+        max = std::max(max, other.max);
+    }
+    // Upper bound of 'p' percentile, in us
+    double percentile(double p) const
+    {
+        uint64_t rank = uint64_t(p / 100 * total);
+        uint64_t seen = 0;
+        for(uint32_t i = 0; i < buckets - 1; ++i)
+        {
+            seen += counts[i];
+            if (seen > rank) return (i + 1) * step / 1000.0;
+        }
+        return max / 1000.0;
+    }
+};
+
+static void merge(FrameStats& dst, const FrameStats& src)
+{
+    if (!src.frames) return;
+    if (!dst.frames || src.min < dst.min) dst.min = src.min;
+    if (src.max > dst.max) dst.max = src.max;
+    dst.total += src.total;
+    dst.frames += src.frames;
+}
+
+struct GameResult {
+    uint32_t score;
+    uint32_t frames;
+    uint32_t checksum;
+    bool finished;  // false - safety frame limit reached
+};
+
+// Bot keys until 'time_limit', then press quit key every other frame
+static KeySource limit_time(KeySource bot, uint8_t quit)
+{
+    return [bot = std::move(bot), quit](uint32_t frame) mutable -> uint8_t {
+        if (frame < time_limit) return bot ? bot(frame) : 0;
+        return frame & 1 ? quit : 0;
+    };
+}
+
+static void play_games(const Policy& policy, int game, uint8_t quit, uint32_t seed, std::atomic<uint32_t>& next,
+    std::vector<GameResult>& results, CostHistogram& costs, FrameStats& search)
+{
+    std::vector<uint32_t> frame_costs;
+    headless_frame_costs(&frame_costs);
+    for(uint32_t i; (i = next++) < results.size();)
+    {
+        GameResult& r = results[i];
+        ArenaScope scope;
+        Autoplayer* bot = nullptr;
+        if (policy.create)
+        {
+            headless_reset(seed + i, limit_time(policy.create(seed + i), quit), max_game_frames);
+        }
+        else
+        {
+            // Any key stops autoplayer game (see 'run_game'), so quit key at time limit works here too
+            headless_reset(seed + i, limit_time(nullptr, quit), max_game_frames);
+            bot = games[game].create_bot();
+        }
+        pixs.clear();
+        try
+        {
+            r.score = run_game(game, bot);
+            r.finished = true;
+        }
+        catch (FrameLimit&)
+        {
+            r.score = 0;
+            r.finished = false;
+        }
+        r.frames = headless_frame();
+        r.checksum = headless_checksum();
+        if (bot) merge(search, bot->search);
+        costs.add(frame_costs);
+        frame_costs.clear();
+    }
+    headless_frame_costs(nullptr);
+}
+
+static int run_tournament(const Policy& policy, uint32_t total, uint32_t threads, uint32_t seed)
+{
+    int game = -1;
+    for(int i = 0; i < total_games; ++i) if (!strcmp(policy.game, games[i].name)) game = i;
+    uint8_t quit = 0;
+    for(auto& q: quit_keys) if (!strcmp(policy.game, q.game)) quit = q.key;
+
+    std::vector<GameResult> results(total);
+    std::vector<CostHistogram> costs(threads);
+    std::vector<FrameStats> search(threads);
+    std::atomic<uint32_t> next{0};
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for(uint32_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back(play_games, std::cref(policy), game, quit, seed, std::ref(next), std::ref(results), std::ref(costs[t]),
+            std::ref(search[t]));
+    }
+    for(auto& w: workers) w.join();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    uint64_t frames = 0;
+    uint32_t aborted = 0, stopped = 0, checksum = 0;
+    std::vector<uint32_t> scores;
+    for(auto& r: results)
+    {
+        frames += r.frames;
+        if (r.frames >= time_limit) ++stopped;
+        checksum = checksum * 31 + r.checksum;
+        if (r.finished) scores.push_back(r.score); else ++aborted;
+    }
+    for(uint32_t t = 1; t < threads; ++t)
+    {
+        costs[0].add(costs[t]);
+        merge(search[0], search[t]);
+    }
+    std::sort(scores.begin(), scores.end());
+    auto score_at = [&](double p) {return scores[std::min(size_t(p / 100 * scores.size()), scores.size() - 1)];};
+
+    printf("%s by %s: %u games (%u stopped at time limit, %u aborted) in %u threads\n", policy.game, policy.name, total,
+        stopped - aborted, aborted, threads);
+    printf("%llu frames in %.3f s: %.0f games/s, %.0f frames/s (x%.0f of real time)\n", (unsigned long long)frames,
+        elapsed.count(), total / elapsed.count(), frames / elapsed.count(), frames * tick_time / 1000.0 / elapsed.count());
+    if (!scores.empty())
+    {
+        uint64_t sum = 0;
+        for(uint32_t s: scores) sum += s;
+        printf("Score min/p10/p50/p90/max %u/%u/%u/%u/%u, avg %.2f\n", scores.front(), score_at(10), score_at(50),
+            score_at(90), scores.back(), double(sum) / scores.size());
+    }
+    const CostHistogram& c = costs[0];
+    printf("Frame cost p50/p90/p99/p99.9/max %.2f/%.2f/%.2f/%.2f/%.2f us\n", c.percentile(50), c.percentile(90),
+        c.percentile(99), c.percentile(99.9), c.max / 1000.0);
+    const FrameStats& s = search[0];
+    if (s.frames)
+    {
+        printf("Bot search min/avg/max %.2f/%.2f/%.2f us (%u searches)\n", double(s.min) / cycles_per_us,
+            double(s.avg()) / cycles_per_us, double(s.max) / cycles_per_us, s.frames);
+    }
+    printf("Checksum: %08X\n", checksum);
+    return 0;
+}
+
+static int usage(const char* name)
+{
+    printf("Usage:\n"
+           "  %s <tetris|snake|invation> [policy=random] [games=1000] [threads=all cores] [seed=1]\n"
+           "  %s list\n", name, name);
+    return 1;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) return usage(argv[0]);
+    if (!strcmp(argv[1], "list"))
+    {
+        for(auto& p: policies) printf("%-10s %-10s %s\n", p.game, p.name, p.description);
+        return 0;
+    }
+    const char* name = argc > 2 ? argv[2] : "random";
+    const Policy* policy = nullptr;
+    for(auto& p: policies) if (!strcmp(argv[1], p.game) && !strcmp(name, p.name)) policy = &p;
+    if (!policy) return usage(argv[0]);
+
+    int total = argc > 3 ? atoi(argv[3]) : 1000;
+    int threads = argc > 4 ? atoi(argv[4]) : int(std::thread::hardware_concurrency());
+    if (total <= 0) return usage(argv[0]);
+    return run_tournament(*policy, total, std::max(threads, 1), argc > 5 ? atoi(argv[5]) : 1);
+}
@@ -0,0 +1,854 @@
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+#include "board.h"
+#include "elf_image.h"
+
+// Peripheral address map (see 'ch32v20x.h')
+enum : uint32_t {
+    TIM2_BASE   = 0x40000000,
+    TIM3_BASE   = 0x40000400,
+    SPI2_BASE   = 0x40003800,
+    AFIO_BASE   = 0x40010000,
+    EXTI_BASE   = 0x40010400,
+    GPIOA_BASE  = 0x40010800,
+    GPIOB_BASE  = 0x40010C00,
+    ADC1_BASE   = 0x40012400,
+    SPI1_BASE   = 0x40013000,
+    USART1_BASE = 0x40013800,
+    DMA1_BASE   = 0x40020000,
+    RCC_BASE    = 0x40021000,
+    CRC_BASE    = 0x40023000,
+    DEBUG_DATA  = 0xE0000380, // SDI printf mailbox (see 'debug.c')
+    PFIC_BASE   = 0xE000E000,
+    SYSTICK_BASE= 0xE000F000,
+};
+
+static constexpr int exti_irq(int line) {return line < 5 ? 22 + line : line < 10 ? 39 : 56;}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// PFIC
+
+void Pfic::set_line(int irq, bool level, uint64_t now)
+{
+    uint64_t bit = uint64_t(1) << irq;
+    if (level && !(lines & bit)) set_pending(irq, now);
+    lines = level ? lines | bit : lines & ~bit;
+}
+
+void Pfic::set_pending(int irq, uint64_t now)
+{
+    uint64_t bit = uint64_t(1) << irq;
+    if (pending & bit) return;
+    pending |= bit;
+    pend_time[irq] = now;
+    changed = true;
+}
+
+// Priority group 1 (as firmware configures it): bit 7 of priority is preemption level, bits 6-5 - subpriority
+int Pfic::select(bool mie, bool nesting) const
+{
+    uint64_t candidates = pending & enabled;
+    if (!candidates) return -1;
+    if (active.empty() ? !mie : !nesting) return -1;
+
+    int best = -1;
+    for(int irq = 0; irq < irqs; ++irq)
+    {
+        if (!(candidates >> irq & 1)) continue;
+        if (priority[irq] < threshold && threshold) continue;
+        if (!active.empty() && (priority[irq] >> 7) >= (priority[active.back()] >> 7)) continue;
+        if (best < 0 || priority[irq] < priority[best]) best = irq;
+    }
+    return best;
+}
+
+void Pfic::enter(int irq)
+{
+    pending &= ~(uint64_t(1) << irq);
+    active.push_back(irq);
+    changed = true;
+}
+
+void Pfic::exit(uint64_t now)
+{
+    if (active.empty()) return;
+    int irq = active.back();
+    active.pop_back();
+    if (lines >> irq & 1) set_pending(irq, now);
+    changed = true;
+}
+
+uint32_t Pfic::read(uint32_t offset) const
+{
+    auto word = [](uint64_t bits, uint32_t idx) {return idx < 2 ? uint32_t(bits >> (32 * idx)) : 0;};
+    uint64_t active_bits = 0;
+    for(int irq: active) active_bits |= uint64_t(1) << irq;
+
+    if (offset < 0x20) return word(enabled, offset / 4);
+    if (offset < 0x40) return word(pending, (offset - 0x20) / 4);
+    if (offset == 0x40) return threshold;
+    if (offset == 0x4C) return uint32_t(active.size()) | (active.empty() ? 0 : 0x100) | ((pending & enabled) ? 0x200 : 0);
+    if (offset >= 0x300 && offset < 0x320) return word(active_bits, (offset - 0x300) / 4);
+    if (offset >= 0x400 && offset < 0x400 + irqs)
+    {
+        uint32_t result;
+        memcpy(&result, priority + (offset - 0x400), 4);
+        return result;
+    }
+    return 0;
+}
+
+void Pfic::write(uint32_t offset, BusWrite w, uint64_t now)
+{
+    uint32_t bits = w.value & w.mask;
+    auto mask64 = [bits](uint32_t idx) {return idx < 2 ? uint64_t(bits) << (32 * idx) : 0;};
+
+    if (offset == 0x40) threshold = w.merge(threshold);
+    else if (offset >= 0x100 && offset < 0x120) enabled |= mask64((offset - 0x100) / 4);
+    else if (offset >= 0x180 && offset < 0x1A0) enabled &= ~mask64((offset - 0x180) / 4);
+    else if (offset >= 0x200 && offset < 0x220)
+    {
+        uint64_t set = mask64((offset - 0x200) / 4);
+        for(int irq = 0; irq < irqs; ++irq) if (set >> irq & 1) set_pending(irq, now);
+    }
+    else if (offset >= 0x280 && offset < 0x2A0) pending &= ~mask64((offset - 0x280) / 4);
+    else if (offset >= 0x400 && offset < 0x400 + irqs)
+    {
+        for(int i = 0; i < 4; ++i)
+        {
+            if (w.mask >> (8 * i) & 0xFF) priority[offset - 0x400 + i] = uint8_t(w.value >> (8 * i));
+        }
+    }
+    changed = true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// SysTick. CTLR: STE (0), STIE (1), STCLK (2, HCLK or HCLK/8), STRE (3, reload on compare), INIT (5), SWIE (31)
+
+uint64_t SysTickTimer::count(uint64_t now) const
+{
+    if (!(ctlr & 1)) return cnt_base;
+    return cnt_base + (now - base_time) / (ctlr & 4 ? 1 : 8);
+}
+
+uint64_t SysTickTimer::next_event() const
+{
+    if ((ctlr & 3) != 3 || cmp <= cnt_base) return UINT64_MAX;
+    return base_time + (cmp - cnt_base) * (ctlr & 4 ? 1 : 8);
+}
+
+void SysTickTimer::event(Board& board, uint64_t time)
+{
+    sr |= 1;
+    cnt_base = ctlr & 8 ? 0 : cmp;
+    base_time = time;
+    board.update_irq_lines();
+}
+
+uint32_t SysTickTimer::read(uint32_t offset, uint64_t now) const
+{
+    switch(offset)
+    {
+    case 0x00: return ctlr;
+    case 0x04: return sr;
+    case 0x08: return uint32_t(count(now));
+    case 0x0C: return uint32_t(count(now) >> 32);
+    case 0x10: return uint32_t(cmp);
+    case 0x14: return uint32_t(cmp >> 32);
+    }
+    return 0;
+}
+
+void SysTickTimer::write(uint32_t offset, BusWrite w, Board& board)
+{
+    uint64_t now = board.time();
+    cnt_base = count(now);
+    base_time = now;
+    switch(offset)
+    {
+    case 0x00:
+        ctlr = w.merge(ctlr);
+        if (ctlr & 0x20) cnt_base = 0;
+        if (ctlr & 0x80000000) board.pfic.set_pending(14, now); // Software interrupt
+        ctlr &= ~0x80000020;
+        break;
+    case 0x04: sr = w.merge(sr); break;
+    case 0x08: cnt_base = (cnt_base & ~uint64_t(0xFFFFFFFF)) | w.merge(uint32_t(cnt_base)); break;
+    case 0x0C: cnt_base = (cnt_base & 0xFFFFFFFF) | uint64_t(w.merge(uint32_t(cnt_base >> 32))) << 32; break;
+    case 0x10: cmp = (cmp & ~uint64_t(0xFFFFFFFF)) | w.merge(uint32_t(cmp)); break;
+    case 0x14: cmp = (cmp & 0xFFFFFFFF) | uint64_t(w.merge(uint32_t(cmp >> 32))) << 32; break;
+    }
+    board.reschedule();
+    board.update_irq_lines();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// General purpose timer
+
+enum TimerReg {
+    CTLR1 = 0x00, DMAINTENR = 0x0C, INTFR = 0x10, SWEVGR = 0x14, CNT = 0x24, PSC = 0x28, ATRLR = 0x2C, CH1CVR = 0x34
+};
+
+uint16_t Timer::count(uint64_t now) const
+{
+    if (!(regs[CTLR1 / 4] & 1)) return cnt_base;
+    return uint16_t(cnt_base + (now - tick_base) / div);
+}
+
+uint64_t Timer::overflow_time() const
+{
+    uint32_t top = cnt_base <= arr ? arr : 0xFFFF;
+    return tick_base + uint64_t(top - cnt_base + 1) * div;
+}
+
+// Counter runs through update events always, compare events are scheduled only for channels with DMA request or interrupt enabled
+uint64_t Timer::next_event() const
+{
+    if (!(regs[CTLR1 / 4] & 1)) return UINT64_MAX;
+    uint64_t result = overflow_time();
+    uint16_t dier = regs[DMAINTENR / 4];
+    uint32_t top = cnt_base <= arr ? arr : 0xFFFF;
+    for(int ch = 0; ch < 4; ++ch)
+    {
+        if (!(dier & (0x202 << ch))) continue;
+        uint16_t ccr = regs[CH1CVR / 4 + ch];
+        if (ccr > cnt_base && ccr <= top) result = std::min(result, tick_base + uint64_t(ccr - cnt_base) * div);
+    }
+    return result;
+}
+
+void Timer::event(Board& board, uint64_t time)
+{
+    if (time == overflow_time())
+    {
+        update_event(board, time);
+    }
+    else
+    {
+        cnt_base = count(time);
+        tick_base = time;
+        for(int ch = 0; ch < 4; ++ch)
+        {
+            if (regs[CH1CVR / 4 + ch] != cnt_base) continue;
+            regs[INTFR / 4] |= 2 << ch;
+            if ((regs[DMAINTENR / 4] & (0x200 << ch)) && dma_cc[ch]) board.dma.request(board, dma_cc[ch]);
+        }
+    }
+    board.update_irq_lines();
+}
+
+// Update event: counter reset, prescaler and auto-reload shadows loaded, UIF set, DMA request
+void Timer::update_event(Board& board, uint64_t time)
+{
+    uint16_t ctlr1 = regs[CTLR1 / 4];
+    cnt_base = 0;
+    tick_base = time;
+    div = (regs[PSC / 4] + 1) * board.timer_div();
+    arr = regs[ATRLR / 4];
+    if (ctlr1 & 8) regs[CTLR1 / 4] &= ~1; // One pulse mode
+    if (ctlr1 & 2) return; // UDIS
+
+    regs[INTFR / 4] |= 1;
+    if ((regs[DMAINTENR / 4] & 0x100) && dma_update) board.dma.request(board, dma_update);
+    for(int ch = 0; ch < 4; ++ch)
+    {
+        if (regs[CH1CVR / 4 + ch]) continue;
+        regs[INTFR / 4] |= 2 << ch;
+        if ((regs[DMAINTENR / 4] & (0x200 << ch)) && dma_cc[ch]) board.dma.request(board, dma_cc[ch]);
+    }
+}
+
+uint32_t Timer::read(uint32_t offset, uint64_t now) const
+{
+    if (offset == CNT) return count(now);
+    return offset < sizeof(regs) * 2 ? regs[offset / 4] : 0;
+}
+
+void Timer::write(uint32_t offset, BusWrite w, Board& board)
+{
+    if (offset >= sizeof(regs) * 2) return;
+    uint64_t now = board.time();
+
+    // Rebase counter to current tick (prescaler phase is kept)
+    if (regs[CTLR1 / 4] & 1)
+    {
+        uint64_t ticks = (now - tick_base) / div;
+        cnt_base = uint16_t(cnt_base + ticks);
+        tick_base += ticks * div;
+    }
+
+    uint16_t old = regs[offset / 4];
+    uint16_t value = uint16_t(w.merge(old));
+    switch(offset)
+    {
+    case CTLR1:
+        regs[offset / 4] = value;
+        if ((value & 1) && !(old & 1)) tick_base = now;
+        break;
+    case INTFR: // Flags are cleared by writing 0
+        regs[offset / 4] = old & value;
+        break;
+    case SWEVGR:
+        if (value & 1) update_event(board, now);
+        for(int ch = 0; ch < 4; ++ch)
+        {
+            if (!(value & (2 << ch))) continue;
+            regs[INTFR / 4] |= 2 << ch;
+            if ((regs[DMAINTENR / 4] & (0x200 << ch)) && dma_cc[ch]) board.dma.request(board, dma_cc[ch]);
+        }
+        break;
+    case CNT:
+        cnt_base = value;
+        tick_base = now;
+        break;
+    case ATRLR:
+        regs[offset / 4] = value;
+        if (!(regs[CTLR1 / 4] & 0x80)) arr = value; // No preload (ARPE)
+        break;
+    default:
+        regs[offset / 4] = value;
+    }
+    board.reschedule();
+    board.update_irq_lines();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// SPI. CTLR1: BR (5-3), SPE (6), DFF (11), BIDIOE (14), BIDIMODE (15). CTLR2: ERRIE (5), RXNEIE (6), TXEIE (7).
+// STATR: RXNE (0), TXE (1), OVR (6), BSY (7)
+
+void Spi::start(Board& board, uint64_t time)
+{
+    shift = tx_buffer;
+    statr |= 0x82;
+    int bits = ctlr1 & 0x800 ? 16 : 8;
+    done_time = time + uint64_t(bits) * board.pclk_div(apb1) * (2u << (ctlr1 >> 3 & 7));
+}
+
+void Spi::event(Board& board, uint64_t time)
+{
+    if (output) output(shift, time);
+    bool tx_only = (ctlr1 & 0xC000) == 0xC000;
+    if (!tx_only)
+    {
+        if (statr & 1)
+        {
+            statr |= 0x40;
+            ++rx_overruns;
+        }
+        statr |= 1;
+    }
+    if (!(statr & 2)) start(board, time);
+    else
+    {
+        statr &= ~0x80;
+        done_time = UINT64_MAX;
+    }
+    board.update_irq_lines();
+}
+
+uint32_t Spi::read(uint32_t offset, Board& board)
+{
+    switch(offset)
+    {
+    case 0x00: return ctlr1;
+    case 0x04: return ctlr2;
+    case 0x08: return statr;
+    case 0x0C:
+        statr &= ~0x41;
+        board.update_irq_lines();
+        return 0; // Nothing on MISO
+    }
+    return 0;
+}
+
+void Spi::write(uint32_t offset, BusWrite w, Board& board)
+{
+    uint64_t now = board.time();
+    switch(offset)
+    {
+    case 0x00: ctlr1 = uint16_t(w.merge(ctlr1)); break;
+    case 0x04: ctlr2 = uint16_t(w.merge(ctlr2)); break;
+    case 0x0C:
+        if (!(statr & 2)) ++tx_overruns;
+        tx_buffer = uint16_t(w.value & w.mask);
+        statr &= ~2;
+        break;
+    default: return;
+    }
+    if ((ctlr1 & 0x40) && !(statr & 2) && !(statr & 0x80)) start(board, now);
+    board.reschedule();
+    board.update_irq_lines();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// DMA. CFGR: EN (0), TCIE (1), HTIE (2), TEIE (3), DIR (4, memory -> peripheral), CIRC (5), PINC (6), MINC (7),
+// PSIZE (9-8), MSIZE (11-10), MEM2MEM (14). INTFR: 4 bits per channel - GIF, TCIF, HTIF, TEIF
+
+void Dma::start(Channel& c)
+{
+    c.cur_cnt = c.cntr;
+    c.cur_paddr = c.paddr;
+    c.cur_maddr = c.maddr;
+}
+
+void Dma::request(Board& board, int channel)
+{
+    Channel& c = ch[channel - 1];
+    if (!(c.cfgr & 1) || !c.cur_cnt) return;
+
+    int psize = 1 << (c.cfgr >> 8 & 3);
+    int msize = 1 << (c.cfgr >> 10 & 3);
+    if (on_transfer) on_transfer(channel, c.cntr - c.cur_cnt, board.time());
+    if (c.cfgr & 0x10) board.write(c.cur_paddr, board.read(c.cur_maddr, msize), psize);
+    else board.write(c.cur_maddr, board.read(c.cur_paddr, psize), msize);
+    if (c.cfgr & 0x40) c.cur_paddr += psize;
+    if (c.cfgr & 0x80) c.cur_maddr += msize;
+
+    int shift = 4 * (channel - 1);
+    if (--c.cur_cnt == c.cntr / 2) intfr |= 5u << shift;
+    if (!c.cur_cnt)
+    {
+        if ((c.cfgr & 2) && (intfr >> shift & 2)) ++c.tc_overruns;
+        intfr |= 3u << shift;
+        if (c.cfgr & 0x20) start(c);
+    }
+    board.update_irq_lines();
+}
+
+bool Dma::line(int channel) const
+{
+    uint32_t flags = intfr >> (4 * (channel - 1));
+    uint32_t cfgr = ch[channel - 1].cfgr;
+    return flags & cfgr & 0xE;
+}
+
+uint32_t Dma::read(uint32_t offset) const
+{
+    if (offset == 0x00) return intfr;
+    if (offset < 0x08 || offset >= 0x08 + 20 * channels) return 0;
+    const Channel& c = ch[(offset - 0x08) / 20];
+    switch((offset - 0x08) % 20)
+    {
+    case 0x00: return c.cfgr;
+    case 0x04: return c.cur_cnt;
+    case 0x08: return c.paddr;
+    case 0x0C: return c.maddr;
+    }
+    return 0;
+}
+
+void Dma::write(uint32_t offset, BusWrite w, Board& board)
+{
+    if (offset == 0x04)
+    {
+        uint32_t clear = w.value & w.mask;
+        for(int i = 0; i < channels; ++i)
+        {
+            if (clear >> (4 * i) & 1) clear |= 0xFu << (4 * i); // GIF clears all flags of channel
+        }
+        intfr &= ~clear;
+    }
+    else if (offset >= 0x08 && offset < 0x08 + 20 * channels)
+    {
+        Channel& c = ch[(offset - 0x08) / 20];
+        switch((offset - 0x08) % 20)
+        {
+        case 0x00:
+        {
+            uint32_t old = c.cfgr;
+            c.cfgr = w.merge(c.cfgr);
+            if ((c.cfgr & 1) && !(old & 1))
+            {
+                start(c);
+                if (c.cfgr & 0x4000) while(c.cur_cnt) request(board, (offset - 0x08) / 20 + 1);
+            }
+            break;
+        }
+        case 0x04: c.cntr = c.cur_cnt = w.merge(c.cntr) & 0xFFFF; break;
+        case 0x08: c.paddr = w.merge(c.paddr); break;
+        case 0x0C: c.maddr = w.merge(c.maddr); break;
+        }
+    }
+    board.update_irq_lines();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// ADC. STATR: EOC (1), STRT (4). CTLR1: EOCIE (5), SCAN (8). CTLR2: ADON (0), CAL (2), RSTCAL (3), DMA (8), SWSTART (22)
+
+enum AdcReg {
+    ADC_STATR = 0x00, ADC_CTLR1 = 0x04, ADC_CTLR2 = 0x08, ADC_SAMPTR1 = 0x0C, ADC_SAMPTR2 = 0x10,
+    ADC_RSQR1 = 0x2C, ADC_RSQR2 = 0x30, ADC_RSQR3 = 0x34, ADC_RDATAR = 0x4C
+};
+
+// Conversion time of sequence position 'pos', in ADC clocks * 2 (sample time + 12.5 clocks)
+static uint32_t adc_conversion_x2(const uint32_t* regs, int pos)
+{
+    static const uint16_t sample_x2[8] = {3, 15, 27, 57, 83, 111, 143, 479};
+    uint32_t sq = pos < 6 ? regs[ADC_RSQR3 / 4] >> (5 * pos) : pos < 12 ? regs[ADC_RSQR2 / 4] >> (5 * (pos - 6)) : regs[ADC_RSQR1 / 4] >> (5 * (pos - 12));
+    uint32_t channel = sq & 31;
+    uint32_t smp = channel < 10 ? regs[ADC_SAMPTR2 / 4] >> (3 * channel) : regs[ADC_SAMPTR1 / 4] >> (3 * (channel - 10));
+    return sample_x2[smp & 7] + 25;
+}
+
+void Adc::event(Board& board, uint64_t time)
+{
+    regs[ADC_RDATAR / 4] = sample_value;
+    regs[ADC_STATR / 4] |= 2;
+    if (regs[ADC_CTLR2 / 4] & 0x100) board.dma.request(board, 1);
+
+    int total = regs[ADC_CTLR1 / 4] & 0x100 ? (regs[ADC_RSQR1 / 4] >> 20 & 15) + 1 : 1;
+    if (--samples_left > 0) sample_time = time + adc_conversion_x2(regs, total - samples_left) * board.adc_div() / 2;
+    else
+    {
+        sample_time = UINT64_MAX;
+        regs[ADC_STATR / 4] &= ~0x10;
+    }
+    board.update_irq_lines();
+}
+
+uint32_t Adc::read(uint32_t offset)
+{
+    if (offset >= sizeof(regs)) return 0;
+    if (offset == ADC_RDATAR) regs[ADC_STATR / 4] &= ~2;
+    return regs[offset / 4];
+}
+
+void Adc::write(uint32_t offset, BusWrite w, Board& board)
+{
+    if (offset >= sizeof(regs)) return;
+    uint32_t value = w.merge(regs[offset / 4]);
+    if (offset == ADC_STATR) value = regs[offset / 4] & value; // Flags are cleared by writing 0
+    if (offset == ADC_CTLR2)
+    {
+        if ((value & 0x400001) == 0x400001 && samples_left <= 0)
+        {
+            samples_left = regs[ADC_CTLR1 / 4] & 0x100 ? (regs[ADC_RSQR1 / 4] >> 20 & 15) + 1 : 1;
+            sample_time = board.time() + adc_conversion_x2(regs, 0) * board.adc_div() / 2;
+            regs[ADC_STATR / 4] |= 0x10;
+        }
+        value &= ~0x40000C; // SWSTART and calibration are done instantly
+    }
+    regs[offset / 4] = value;
+    board.reschedule();
+    board.update_irq_lines();
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// LED matrix
+
+bool LedMatrix::Image::operator==(const Image& other) const
+{
+    return !memcmp(br, other.br, sizeof(br));
+}
+
+void LedMatrix::integrate(uint64_t now)
+{
+    uint64_t dt = now - last_change;
+    last_change = now;
+    if (oe_n || !dt) return;
+    for(int c = 0; c < 8; ++c)
+    {
+        if (cols >> c & 1) continue;
+        for(int b = 0; b < 16; ++b)
+        {
+            if (rows_out >> b & 1) on_time[c + (b & 8)][b & 7] += dt;
+        }
+    }
+}
+
+void LedMatrix::set_cols(uint8_t value, uint64_t now)
+{
+    integrate(now);
+    cols = value;
+}
+
+void LedMatrix::shift_rows(uint16_t value, uint64_t now)
+{
+    rows_shift = value;
+    if (!le) return;
+    integrate(now);
+    rows_out = value;
+}
+
+void LedMatrix::set_le(bool level, uint64_t now)
+{
+    if (level)
+    {
+        integrate(now);
+        rows_out = rows_shift;
+    }
+    le = level;
+}
+
+void LedMatrix::set_oe(bool level, uint64_t now)
+{
+    integrate(now);
+    oe_n = level;
+}
+
+bool LedMatrix::frame(uint64_t now, int max_br, Image& image)
+{
+    integrate(now);
+    bool complete = frame_start != UINT64_MAX && now > frame_start;
+    if (complete)
+    {
+        uint64_t len = now - frame_start;
+        for(int y = 0; y < 16; ++y)
+        {
+            for(int x = 0; x < 8; ++x)
+            {
+                uint64_t level = (on_time[y][x] * 16 * max_br + len) / (2 * len);
+                image.br[y][x] = uint8_t(std::min<uint64_t>(level, max_br));
+            }
+        }
+    }
+    memset(on_time, 0, sizeof(on_time));
+    frame_start = now;
+    return complete;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Board
+
+Board::Board(const ElfImage& image)
+{
+    for(auto& seg: image.segments())
+    {
+        uint32_t addr = seg.addr >= flash_alias ? seg.addr - flash_alias : seg.addr;
+        uint8_t* dst = addr + seg.data.size() <= flash_size ? flash + addr :
+                       seg.addr >= ram_base && seg.addr - ram_base + seg.data.size() <= ram_size ? ram + (seg.addr - ram_base) : nullptr;
+        if (!dst) throw std::runtime_error("ELF segment is out of flash and RAM");
+        memcpy(dst, seg.data.data(), seg.data.size());
+    }
+
+    rcc[0] = 0x83; // HSI on and ready
+    for(auto& port: gpio_cfg) port[0] = port[1] = 0x44444444; // Floating inputs
+
+    spi1.output = [this](uint16_t word, uint64_t time) {leds.set_cols(uint8_t(word), time);};
+    spi2.output = [this](uint16_t word, uint64_t time) {leds.shift_rows(word, time);};
+}
+
+uint32_t Board::pclk_div(bool apb1) const
+{
+    uint32_t ppre = rcc[1] >> (apb1 ? 8 : 11) & 7;
+    return ppre < 4 ? 1 : 2u << (ppre - 4);
+}
+
+uint32_t Board::timer_div() const
+{
+    uint32_t div = pclk_div(true);
+    return div > 1 ? div / 2 : 1; // Timer clock is doubled when APB1 is divided
+}
+
+uint32_t Board::adc_div() const
+{
+    return pclk_div(false) * 2 * ((rcc[1] >> 14 & 3) + 1);
+}
+
+uint32_t Board::read(uint32_t addr, int size)
+{
+    uint32_t result = 0;
+    if (addr - ram_base <= ram_size - size) memcpy(&result, ram + (addr - ram_base), size);
+    else if (addr <= flash_size - size) memcpy(&result, flash + addr, size);
+    else if (addr - flash_alias <= flash_size - size) memcpy(&result, flash + (addr - flash_alias), size);
+    else
+    {
+        result = io_read(addr & ~3) >> (8 * (addr & 3));
+        if (size < 4) result &= (1u << (8 * size)) - 1;
+    }
+    return result;
+}
+
+void Board::write(uint32_t addr, uint32_t value, int size)
+{
+    if (addr - ram_base <= ram_size - size) memcpy(ram + (addr - ram_base), &value, size);
+    else if (addr < flash_size || addr - flash_alias < flash_size) ++flash_writes;
+    else
+    {
+        uint32_t shift = 8 * (addr & 3);
+        uint32_t mask = size < 4 ? (1u << (8 * size)) - 1 : 0xFFFFFFFF;
+        io_write(addr & ~3, {value << shift, mask << shift});
+    }
+}
+
+void Board::process_events()
+{
+    in_event = true;
+    while(now >= next_event)
+    {
+        event_time = next_event;
+        if (systick.next_event() == event_time) systick.event(*this, event_time);
+        if (tim2.next_event() == event_time) tim2.event(*this, event_time);
+        if (tim3.next_event() == event_time) tim3.event(*this, event_time);
+        if (spi1.next_event() == event_time) spi1.event(*this, event_time);
+        if (spi2.next_event() == event_time) spi2.event(*this, event_time);
+        if (adc.next_event() == event_time) adc.event(*this, event_time);
+        reschedule();
+    }
+    in_event = false;
+}
+
+void Board::reschedule()
+{
+    next_event = std::min({systick.next_event(), tim2.next_event(), tim3.next_event(),
+                           spi1.next_event(), spi2.next_event(), adc.next_event()});
+}
+
+void Board::update_irq_lines()
+{
+    uint64_t t = time();
+    pfic.set_line(SysTickTimer::irq, (systick.sr & 1) && (systick.ctlr & 2), t);
+    for(Timer* tim: {&tim2, &tim3}) pfic.set_line(tim->irq, tim->regs[INTFR / 4] & tim->regs[DMAINTENR / 4] & 0x5F, t);
+    for(Spi* spi: {&spi1, &spi2})
+    {
+        pfic.set_line(spi->irq, ((spi->statr & 1) && (spi->ctlr2 & 0x40)) || ((spi->statr & 2) && (spi->ctlr2 & 0x80)) ||
+                                ((spi->statr & 0x40) && (spi->ctlr2 & 0x20)), t);
+    }
+    for(int c = 1; c < Dma::channels; ++c) pfic.set_line(Dma::first_irq + c - 1, dma.line(c), t);
+    pfic.set_line(Adc::irq, (adc.regs[ADC_STATR / 4] & 2) && (adc.regs[ADC_CTLR1 / 4] & 0x20), t);
+
+    uint32_t exti_active = exti[5] & exti[0];
+    for(int line = 0; line < 5; ++line) pfic.set_line(exti_irq(line), exti_active >> line & 1, t);
+    pfic.set_line(exti_irq(5), exti_active & 0x3E0, t);
+    pfic.set_line(exti_irq(10), exti_active & 0xFC00, t);
+}
+
+// Port A: buttons on PA0-PA7 (pulled up, pressed button shorts pin to ground), other pins read back outputs
+uint16_t Board::gpio_in(int port) const
+{
+    return port ? gpio_out[1] : (gpio_out[0] & 0xFF00) | uint8_t(~buttons);
+}
+
+void Board::gpio_changed(int port, uint16_t old_pins, uint16_t new_pins)
+{
+    uint16_t changed = old_pins ^ new_pins;
+    if (!changed) return;
+    uint64_t t = time();
+    if (port == 1)
+    {
+        if (changed & (1 << 12)) leds.set_le(new_pins >> 12 & 1, t);
+        if (changed & (1 << 11)) leds.set_oe(new_pins >> 11 & 1, t);
+    }
+
+    // EXTI lines connected to this port (AFIO EXTICR)
+    for(int line = 0; line < 16; ++line)
+    {
+        if (!(changed >> line & 1)) continue;
+        uint32_t exticr = storage[AFIO_BASE + 8 + 4 * (line / 4)];
+        if ((exticr >> (4 * (line % 4)) & 0xF) != uint32_t(port)) continue;
+        bool rising = new_pins >> line & 1;
+        if (((rising ? exti[2] : exti[3]) >> line) & 1) exti[5] |= 1u << line;
+    }
+    update_irq_lines();
+}
+
+void Board::set_buttons(uint8_t pressed)
+{
+    uint16_t old_pins = gpio_in(0);
+    buttons = pressed;
+    gpio_changed(0, old_pins, gpio_in(0));
+}
+
+uint32_t Board::io_read(uint32_t addr)
+{
+    uint64_t t = time();
+    if (addr - TIM2_BASE < 0x400) return tim2.read(addr - TIM2_BASE, t);
+    if (addr - TIM3_BASE < 0x400) return tim3.read(addr - TIM3_BASE, t);
+    if (addr - SPI1_BASE < 0x400) return spi1.read(addr - SPI1_BASE, *this);
+    if (addr - SPI2_BASE < 0x400) return spi2.read(addr - SPI2_BASE, *this);
+    if (addr - DMA1_BASE < 0x400) return dma.read(addr - DMA1_BASE);
+    if (addr - ADC1_BASE < 0x400) return adc.read(addr - ADC1_BASE);
+    if (addr - EXTI_BASE < sizeof(exti)) return exti[(addr - EXTI_BASE) / 4];
+    if (addr - PFIC_BASE < 0x1000) return pfic.read(addr - PFIC_BASE);
+    if (addr - SYSTICK_BASE < 0x20) return systick.read(addr - SYSTICK_BASE, t);
+    if (addr - GPIOA_BASE < 0x800)
+    {
+        int port = (addr - GPIOA_BASE) / 0x400;
+        switch(addr & 0x3FF)
+        {
+        case 0x00: return gpio_cfg[port][0];
+        case 0x04: return gpio_cfg[port][1];
+        case 0x08: return gpio_in(port);
+        case 0x0C: return gpio_out[port];
+        }
+        return 0;
+    }
+    if (addr == RCC_BASE) return rcc[0] | (rcc[0] & 0x15010001) << 1; // Ready flags follow enables (HSI, HSE, PLL, PLL2, PLL3)
+    if (addr == RCC_BASE + 4) return (rcc[1] & ~0xC) | (rcc[1] & 3) << 2; // SWS = SW
+    if (addr - RCC_BASE < sizeof(rcc)) return rcc[(addr - RCC_BASE) / 4];
+    if (addr == USART1_BASE) return 0xC0; // TXE, TC: transmitter is always ready
+    if (addr == CRC_BASE) return crc;
+    auto it = storage.find(addr);
+    return it == storage.end() ? 0 : it->second;
+}
+
+void Board::io_write(uint32_t addr, BusWrite w)
+{
+    if (addr - TIM2_BASE < 0x400) return tim2.write(addr - TIM2_BASE, w, *this);
+    if (addr - TIM3_BASE < 0x400) return tim3.write(addr - TIM3_BASE, w, *this);
+    if (addr - SPI1_BASE < 0x400) return spi1.write(addr - SPI1_BASE, w, *this);
+    if (addr - SPI2_BASE < 0x400) return spi2.write(addr - SPI2_BASE, w, *this);
+    if (addr - DMA1_BASE < 0x400) return dma.write(addr - DMA1_BASE, w, *this);
+    if (addr - ADC1_BASE < 0x400) return adc.write(addr - ADC1_BASE, w, *this);
+    if (addr - PFIC_BASE < 0x1000) return pfic.write(addr - PFIC_BASE, w, time());
+    if (addr - SYSTICK_BASE < 0x20) return systick.write(addr - SYSTICK_BASE, w, *this);
+    if (addr - EXTI_BASE < sizeof(exti))
+    {
+        int reg = (addr - EXTI_BASE) / 4;
+        if (reg == 5) exti[5] &= ~(w.value & w.mask);     // INTFR: write 1 to clear
+        else if (reg == 4) exti[5] |= w.value & w.mask;   // SWIEVR: software event
+        else exti[reg] = w.merge(exti[reg]);
+        return update_irq_lines();
+    }
+    if (addr - GPIOA_BASE < 0x800)
+    {
+        int port = (addr - GPIOA_BASE) / 0x400;
+        uint16_t old_pins = gpio_in(port);
+        uint32_t bits = w.value & w.mask;
+        switch(addr & 0x3FF)
+        {
+        case 0x00: gpio_cfg[port][0] = w.merge(gpio_cfg[port][0]); break;
+        case 0x04: gpio_cfg[port][1] = w.merge(gpio_cfg[port][1]); break;
+        case 0x0C: gpio_out[port] = uint16_t(w.merge(gpio_out[port])); break;
+        case 0x10: gpio_out[port] = uint16_t((gpio_out[port] & ~(bits >> 16)) | bits); break; // BSHR: set has priority
+        case 0x14: gpio_out[port] &= ~bits; break;
+        }
+        return gpio_changed(port, old_pins, gpio_in(port));
+    }
+    if (addr - RCC_BASE < sizeof(rcc))
+    {
+        uint32_t& reg = rcc[(addr - RCC_BASE) / 4];
+        reg = w.merge(reg);
+        return reschedule();
+    }
+    if (addr == USART1_BASE + 4)
+    {
+        if (uart) fputc(int(w.value & 0xFF), uart);
+        return;
+    }
+    if (addr == DEBUG_DATA) // Length in byte 0, then up to 7 chars: 3 in this word, 4 in next one
+    {
+        uint32_t data1 = storage[DEBUG_DATA + 4];
+        for(uint32_t i = 0; i < (w.value & 7); ++i)
+        {
+            char c = char(i < 3 ? w.value >> (8 * (i + 1)) : data1 >> (8 * (i - 3)));
+            if (uart) fputc(c, uart);
+        }
+        return;
+    }
+    if (addr == CRC_BASE) // CRC-32 (0x04C11DB7) of 32-bit words, MSB first
+    {
+        crc ^= w.value;
+        for(int i = 0; i < 32; ++i) crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        return;
+    }
+    if (addr == CRC_BASE + 8 && (w.value & w.mask & 1))
+    {
+        crc = 0xFFFFFFFF;
+        return;
+    }
+    uint32_t& reg = storage[addr];
+    reg = w.merge(reg);
+}
@@ -0,0 +1,254 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+class ElfImage;
+class Board;
+
+/*
+    CH32V203C8 board model: memory, peripherals used by firmware and LED matrix.
+
+    Time is counted in HCLK cycles ('Board::now'), CPU advances it by instruction costs.
+    Peripherals are event driven - each one reports time of its next event, 'process_events' runs all due events.
+    Only features used by firmware are modelled; other peripheral registers are plain storage.
+*/
+
+// Bus access to peripheral register: 'value' and 'mask' are already shifted to byte lanes of aligned word
+struct BusWrite {
+    uint32_t value;
+    uint32_t mask;
+
+    uint32_t merge(uint32_t old) const {return (old & ~mask) | (value & mask);}
+};
+
+// Interrupt controller (PFIC). Peripherals drive interrupt lines, rising edge of line makes interrupt pending
+class Pfic {
+public:
+    static constexpr int irqs = 64; // CH32V203: 16 core + 47 peripheral interrupts
+
+    uint64_t pend_since(int irq) const {return pend_time[irq];}
+    void set_line(int irq, bool level, uint64_t now);
+    void set_pending(int irq, uint64_t now);
+
+    // Interrupt to take now (-1 if none). 'mie' - global interrupt enable, 'nesting' - INTSYSCR.INESTEN
+    int select(bool mie, bool nesting) const;
+    bool wakeup() const {return pending & enabled;} // WFI exit condition (ignores global enable)
+    void enter(int irq);
+    void exit(uint64_t now); // Leave active interrupt, it is pended again if its line is still active
+
+    uint32_t read(uint32_t offset) const;
+    void write(uint32_t offset, BusWrite w, uint64_t now);
+
+    bool changed = true; // Set on any change of pending/enabled/active state (CPU rechecks interrupts)
+
+private:
+    uint64_t enabled = 0;
+    uint64_t pending = 0;
+    uint64_t lines = 0;
+    uint8_t priority[irqs] = {};
+    uint64_t pend_time[irqs] = {};
+    std::vector<int> active;
+    uint32_t threshold = 0;
+};
+
+// Cortex-like system timer of QingKe core (64-bit counter, compare interrupt). Up-counting mode only
+struct SysTickTimer {
+    static constexpr int irq = 12;
+
+    uint32_t ctlr = 0;
+    uint32_t sr = 0;
+    uint64_t cnt_base = 0;  // Counter value at 'base_time'
+    uint64_t base_time = 0;
+    uint64_t cmp = 0;
+
+    uint64_t count(uint64_t now) const;
+    uint64_t next_event() const;
+    void event(Board& board, uint64_t time);
+    uint32_t read(uint32_t offset, uint64_t now) const;
+    void write(uint32_t offset, BusWrite w, Board& board);
+};
+
+// General purpose timer: up-counting, update and compare events, DMA requests and interrupt. No outputs
+struct Timer {
+    int irq;
+    int dma_update;         // DMA channels of requests (0 - none)
+    int dma_cc[4];
+
+    uint16_t regs[0x50 / 4] = {};
+    uint16_t arr = 0xFFFF;  // Active auto-reload value
+    uint32_t div = 1;       // Active prescaler (HCLK cycles per tick)
+    uint16_t cnt_base = 0;  // Counter value at 'tick_base'
+    uint64_t tick_base = 0; // Time of counter tick
+
+    uint16_t count(uint64_t now) const;
+    uint64_t next_event() const;
+    void event(Board& board, uint64_t time);
+    uint32_t read(uint32_t offset, uint64_t now) const;
+    void write(uint32_t offset, BusWrite w, Board& board);
+
+private:
+    uint64_t overflow_time() const;
+    void update_event(Board& board, uint64_t time);
+};
+
+// SPI master (transmit side): TX buffer + shift register, RXNE on every transferred frame
+struct Spi {
+    int irq;
+    bool apb1;              // Clocked by PCLK1 (else PCLK2)
+    std::function<void(uint16_t word, uint64_t time)> output; // Device on bus
+
+    uint16_t ctlr1 = 0, ctlr2 = 0, statr = 2;
+    uint16_t tx_buffer = 0;
+    uint16_t shift = 0;
+    uint64_t done_time = UINT64_MAX; // End of current frame transfer
+    uint32_t tx_overruns = 0;   // DATAR written when TX buffer was full (frame lost)
+    uint32_t rx_overruns = 0;   // Frame received when RXNE was still set
+
+    uint64_t next_event() const {return done_time;}
+    void event(Board& board, uint64_t time);
+    uint32_t read(uint32_t offset, Board& board);
+    void write(uint32_t offset, BusWrite w, Board& board);
+
+private:
+    void start(Board& board, uint64_t time);
+};
+
+// DMA1 controller: 8 channels, transfers are instant (bus contention is not modelled)
+struct Dma {
+    static constexpr int channels = 8;
+    static constexpr int first_irq = 27; // DMA1_Channel1_IRQn (channel 8 is not used)
+
+    struct Channel {
+        uint32_t cfgr = 0, cntr = 0, paddr = 0, maddr = 0;
+        uint32_t cur_cnt = 0, cur_paddr = 0, cur_maddr = 0; // Internal state of transfer
+        uint32_t tc_overruns = 0; // Transfer completed while TC flag was still set (TC interrupt lost or late)
+    };
+
+    Channel ch[channels];
+    uint32_t intfr = 0;
+    std::function<void(int channel, uint32_t index, uint64_t time)> on_transfer; // Observer (LED scan frames)
+
+    void request(Board& board, int channel);   // Channel numbers from 1
+    uint32_t read(uint32_t offset) const;
+    void write(uint32_t offset, BusWrite w, Board& board);
+    bool line(int channel) const;
+
+private:
+    void start(Channel& c);
+};
+
+// ADC1: software triggered scan sequences to DMA. Every sample is 'sample_value'
+struct Adc {
+    static constexpr int irq = 34;
+    static constexpr uint16_t sample_value = 2048;
+
+    uint32_t regs[0x50 / 4] = {};
+    int samples_left = 0;
+    uint64_t sample_time = UINT64_MAX;
+
+    uint64_t next_event() const {return sample_time;}
+    void event(Board& board, uint64_t time);
+    uint32_t read(uint32_t offset);
+    void write(uint32_t offset, BusWrite w, Board& board);
+};
+
+/*
+    LED matrix 8x16, as driven by firmware scan:
+      SPI1 -> column driver (8 bit shift register, active low outputs, no latch)
+      SPI2 -> STP16 constant current driver: shift register, latched while LE (PB12) is high, outputs enabled by OE (PB11, low)
+    Column C lights lines Y=C and Y=C+8, STP16 output X (0..7) is pixel X of line C, output X+8 - pixel X of line C+8.
+    Brightness of pixel is its on time in frame, in units of 1/(8*max_br) of frame (bit-angle modulation, see 'platform.cpp').
+*/
+class LedMatrix {
+public:
+    struct Image {
+        uint8_t br[16][8]; // [y][x], 0..max_br
+
+        bool operator==(const Image& other) const;
+    };
+
+    void set_cols(uint8_t value, uint64_t now);
+    void shift_rows(uint16_t value, uint64_t now);
+    void set_le(bool level, uint64_t now);
+    void set_oe(bool level, uint64_t now);
+
+    // Frame boundary: convert integrated on time to brightness. Returns false for first (incomplete) frame
+    bool frame(uint64_t now, int max_br, Image& image);
+
+private:
+    uint8_t cols = 0xFF;
+    uint16_t rows_shift = 0;
+    uint16_t rows_out = 0;
+    bool le = false;
+    bool oe_n = true;
+    uint64_t last_change = 0;
+    uint64_t frame_start = UINT64_MAX;
+    uint64_t on_time[16][8] = {};
+
+    void integrate(uint64_t now);
+};
+
+class Board {
+public:
+    static constexpr uint32_t flash_size = 64 * 1024;
+    static constexpr uint32_t flash_alias = 0x08000000;
+    static constexpr uint32_t ram_base = 0x20000000;
+    static constexpr uint32_t ram_size = 20 * 1024;
+    static constexpr uint32_t hclk = 144000000;
+
+    explicit Board(const ElfImage& image);
+
+    uint64_t now = 0;                   // HCLK cycles since reset
+    uint64_t next_event = UINT64_MAX;
+
+    uint8_t flash[flash_size] = {};
+    uint8_t ram[ram_size] = {};
+
+    Pfic pfic;
+    SysTickTimer systick;
+    Timer tim2{44, 2, {5, 7, 1, 7}};
+    Timer tim3{45, 3, {6, 0, 2, 3}};
+    Spi spi1{51, false, nullptr};
+    Spi spi2{52, true, nullptr};
+    Dma dma;
+    Adc adc;
+    LedMatrix leds;
+
+    FILE* uart = stdout;                // Debug USART1 output
+
+    uint32_t read(uint32_t addr, int size);
+    void write(uint32_t addr, uint32_t value, int size);
+
+    uint64_t time() const {return in_event ? event_time : now;} // Time of current bus access (CPU or peripheral event)
+    void process_events();              // Run all events due at 'now'
+    void reschedule();                  // Recalculate 'next_event' (call after peripheral state change)
+    void update_irq_lines();            // Recalculate interrupt lines of peripherals
+
+    void set_buttons(uint8_t pressed);  // Bit N - button on PA<N> is pressed
+
+    uint32_t pclk_div(bool apb1) const; // HCLK cycles per PCLK1/PCLK2 cycle
+    uint32_t timer_div() const;         // HCLK cycles per APB1 timer clock
+    uint32_t adc_div() const;           // HCLK cycles per ADC clock
+
+    uint32_t flash_writes = 0;          // Attempts to write flash (ignored)
+
+private:
+    bool in_event = false;
+    uint64_t event_time = 0;
+    uint32_t rcc[0x30 / 4] = {};
+    uint32_t gpio_cfg[2][2] = {};
+    uint16_t gpio_out[2] = {};
+    uint8_t buttons = 0;
+    uint32_t exti[6] = {};
+    uint32_t crc = 0xFFFFFFFF;
+    std::unordered_map<uint32_t, uint32_t> storage; // Registers without behaviour
+
+    uint16_t gpio_in(int port) const;
+    void gpio_changed(int port, uint16_t old_pins, uint16_t new_pins);
+    uint32_t io_read(uint32_t addr);
+    void io_write(uint32_t addr, BusWrite w);
+};
@@ -0,0 +1,558 @@
+#include <algorithm>
+#include <stdio.h>
+
+#include "cpu.h"
+
+namespace {
+
+enum Op : uint8_t {
+    ILLEGAL,
+    LUI, AUIPC, JAL, JALR,
+    BEQ, BNE, BLT, BGE, BLTU, BGEU,
+    LB, LH, LW, LBU, LHU, SB, SH, SW,
+    ADDI, SLTI, SLTIU, XORI, ORI, ANDI, SLLI, SRLI, SRAI,
+    ADD, SUB, SLL, SLT, SLTU, XOR, SRL, SRA, OR, AND,
+    MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU,
+    LR, SC, AMOSWAP, AMOADD, AMOXOR, AMOAND, AMOOR, AMOMIN, AMOMAX, AMOMINU, AMOMAXU,
+    FENCE, ECALL, EBREAK, MRET, WFI,
+    CSRRW, CSRRS, CSRRC, CSRRWI, CSRRSI, CSRRCI,
+};
+
+constexpr int32_t sext(uint32_t value, int bits) {return int32_t(value << (32 - bits)) >> (32 - bits);}
+
+// Registers saved by hardware prologue (HPE)
+constexpr uint8_t hpe_regs[16] = {1, 5, 6, 7, 10, 11, 12, 13, 14, 15, 16, 17, 28, 29, 30, 31};
+
+} // namespace
+
+Cpu::Cpu(Board& board, uint32_t reset_pc) : pc(reset_pc), slot_cycles(code_slots), slot_calls(code_slots), board(board),
+    flash_cache(Board::flash_size / 2)
+{
+}
+
+uint32_t Cpu::code_slot(uint32_t addr)
+{
+    if (addr < Board::flash_size) return addr / 2;
+    if (addr - Board::flash_alias < Board::flash_size) return (addr - Board::flash_alias) / 2;
+    if (addr - Board::ram_base < Board::ram_size) return (Board::flash_size + addr - Board::ram_base) / 2;
+    return UINT32_MAX;
+}
+
+uint32_t Cpu::slot_addr(uint32_t slot)
+{
+    return slot < Board::flash_size / 2 ? slot * 2 : Board::ram_base + slot * 2 - Board::flash_size;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Decoder
+
+Cpu::Insn Cpu::decode(uint32_t w)
+{
+    uint8_t rd = w >> 7 & 31, rs1 = w >> 15 & 31, rs2 = w >> 20 & 31;
+    uint32_t f3 = w >> 12 & 7, f7 = w >> 25;
+    int32_t imm_i = int32_t(w) >> 20;
+    int32_t imm_s = (int32_t(w) >> 25 << 5) | (w >> 7 & 31);
+    int32_t imm_b = (int32_t(w) >> 31 << 12) | (w >> 7 & 1) << 11 | (w >> 25 & 0x3F) << 5 | (w >> 8 & 0xF) << 1;
+    int32_t imm_u = int32_t(w & 0xFFFFF000);
+    int32_t imm_j = (int32_t(w) >> 31 << 20) | (w & 0xFF000) | (w >> 20 & 1) << 11 | (w >> 21 & 0x3FF) << 1;
+    Insn bad{ILLEGAL, 0, 0, 0, 0, 4};
+
+    switch(w & 0x7F)
+    {
+    case 0x37: return {LUI, rd, 0, 0, imm_u, 4};
+    case 0x17: return {AUIPC, rd, 0, 0, imm_u, 4};
+    case 0x6F: return {JAL, rd, 0, 0, imm_j, 4};
+    case 0x67: return f3 ? bad : Insn{JALR, rd, rs1, 0, imm_i, 4};
+    case 0x63:
+        {
+            static const uint8_t ops[8] = {BEQ, BNE, ILLEGAL, ILLEGAL, BLT, BGE, BLTU, BGEU};
+            return {ops[f3], 0, rs1, rs2, imm_b, 4};
+        }
+    case 0x03:
+        {
+            static const uint8_t ops[8] = {LB, LH, LW, ILLEGAL, LBU, LHU, ILLEGAL, ILLEGAL};
+            return {ops[f3], rd, rs1, 0, imm_i, 4};
+        }
+    case 0x23:
+        {
+            static const uint8_t ops[8] = {SB, SH, SW, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL, ILLEGAL};
+            return {ops[f3], 0, rs1, rs2, imm_s, 4};
+        }
+    case 0x13:
+        {
+            static const uint8_t ops[8] = {ADDI, SLLI, SLTI, SLTIU, XORI, SRLI, ORI, ANDI};
+            uint8_t op = ops[f3];
+            if (f3 == 1 && f7) return bad;
+            if (f3 == 5)
+            {
+                if (f7 == 0x20) op = SRAI;
+                else if (f7) return bad;
+                return {op, rd, rs1, 0, int32_t(rs2), 4};
+            }
+            return {op, rd, rs1, 0, imm_i, 4};
+        }
+    case 0x33:
+        {
+            static const uint8_t base[8] = {ADD, SLL, SLT, SLTU, XOR, SRL, OR, AND};
+            static const uint8_t mul[8] = {MUL, MULH, MULHSU, MULHU, DIV, DIVU, REM, REMU};
+            uint8_t op;
+            if (f7 == 0) op = base[f3];
+            else if (f7 == 1) op = mul[f3];
+            else if (f7 == 0x20 && f3 == 0) op = SUB;
+            else if (f7 == 0x20 && f3 == 5) op = SRA;
+            else return bad;
+            return {op, rd, rs1, rs2, 0, 4};
+        }
+    case 0x2F:
+        {
+            if (f3 != 2) return bad;
+            uint8_t op;
+            switch(w >> 27)
+            {
+            case 0x02: op = rs2 ? ILLEGAL : LR; break;
+            case 0x03: op = SC; break;
+            case 0x01: op = AMOSWAP; break;
+            case 0x00: op = AMOADD; break;
+            case 0x04: op = AMOXOR; break;
+            case 0x0C: op = AMOAND; break;
+            case 0x08: op = AMOOR; break;
+            case 0x10: op = AMOMIN; break;
+            case 0x14: op = AMOMAX; break;
+            case 0x18: op = AMOMINU; break;
+            case 0x1C: op = AMOMAXU; break;
+            default: return bad;
+            }
+            return {op, rd, rs1, rs2, 0, 4};
+        }
+    case 0x0F: return {FENCE, 0, 0, 0, 0, 4};
+    case 0x73:
+        if (f3 == 0)
+        {
+            switch(w)
+            {
+            case 0x00000073: return {ECALL, 0, 0, 0, 0, 4};
+            case 0x00100073: return {EBREAK, 0, 0, 0, 0, 4};
+            case 0x30200073: return {MRET, 0, 0, 0, 0, 4};
+            case 0x10500073: return {WFI, 0, 0, 0, 0, 4};
+            default: return bad;
+            }
+        }
+        else
+        {
+            static const uint8_t ops[8] = {ILLEGAL, CSRRW, CSRRS, CSRRC, ILLEGAL, CSRRWI, CSRRSI, CSRRCI};
+            return {ops[f3], rd, rs1, 0, int32_t(w >> 20), 4};
+        }
+    default: return bad;
+    }
+}
+
+// RV32C, expanded to base instructions. Floating point slots (and WCH XW extension) are illegal
+Cpu::Insn Cpu::decode16(uint32_t h)
+{
+    uint8_t rd = h >> 7 & 31, rs2 = h >> 2 & 31;
+    uint8_t rd_ = (h >> 2 & 7) + 8, rs1_ = (h >> 7 & 7) + 8; // Compact register fields
+    int32_t imm6 = sext((h >> 7 & 0x20) | (h >> 2 & 0x1F), 6);
+    int32_t imm_j = sext((h >> 1 & 0x800) | (h >> 7 & 0x10) | (h >> 1 & 0x300) | (h << 2 & 0x400) | (h >> 1 & 0x40) |
+                         (h << 1 & 0x80) | (h >> 2 & 0xE) | (h << 3 & 0x20), 12);
+    int32_t imm_b = sext((h >> 4 & 0x100) | (h >> 7 & 0x18) | (h << 1 & 0xC0) | (h >> 2 & 6) | (h << 3 & 0x20), 9);
+    int32_t off_w = (h >> 7 & 0x38) | (h >> 4 & 4) | (h << 1 & 0x40);
+    Insn bad{ILLEGAL, 0, 0, 0, 0, 2};
+
+    switch((h & 3) << 3 | (h >> 13))
+    {
+    // Quadrant 0
+    case 000:
+        {
+            int32_t imm = (h >> 7 & 0x30) | (h >> 1 & 0x3C0) | (h >> 4 & 4) | (h >> 2 & 8);
+            return imm ? Insn{ADDI, rd_, 2, 0, imm, 2} : bad; // c.addi4spn
+        }
+    case 002: return {LW, rd_, rs1_, 0, off_w, 2};
+    case 006: return {SW, 0, rs1_, rd_, off_w, 2};
+
+    // Quadrant 1
+    case 010: return {ADDI, rd, rd, 0, imm6, 2};
+    case 011: return {JAL, 1, 0, 0, imm_j, 2};
+    case 012: return {ADDI, rd, 0, 0, imm6, 2}; // c.li
+    case 013:
+        if (rd == 2)
+        {
+            int32_t imm = sext((h >> 3 & 0x200) | (h >> 2 & 0x10) | (h << 1 & 0x40) | (h << 4 & 0x180) | (h << 3 & 0x20), 10);
+            return imm ? Insn{ADDI, 2, 2, 0, imm, 2} : bad; // c.addi16sp
+        }
+        return imm6 ? Insn{LUI, rd, 0, 0, imm6 << 12, 2} : bad;
+    case 014:
+        switch(h >> 10 & 3)
+        {
+        case 0: return h & 0x1000 ? bad : Insn{SRLI, rs1_, rs1_, 0, imm6 & 31, 2};
+        case 1: return h & 0x1000 ? bad : Insn{SRAI, rs1_, rs1_, 0, imm6 & 31, 2};
+        case 2: return {ANDI, rs1_, rs1_, 0, imm6, 2};
+        default:
+            {
+                if (h & 0x1000) return bad;
+                static const uint8_t ops[4] = {SUB, XOR, OR, AND};
+                return {ops[h >> 5 & 3], rs1_, rs1_, rd_, 0, 2};
+            }
+        }
+    case 015: return {JAL, 0, 0, 0, imm_j, 2};
+    case 016: return {BEQ, 0, rs1_, 0, imm_b, 2};
+    case 017: return {BNE, 0, rs1_, 0, imm_b, 2};
+
+    // Quadrant 2
+    case 020: return h & 0x1000 ? bad : Insn{SLLI, rd, rd, 0, imm6 & 31, 2};
+    case 022:
+        {
+            int32_t off = (h >> 7 & 0x20) | (h >> 2 & 0x1C) | (h << 4 & 0xC0);
+            return rd ? Insn{LW, rd, 2, 0, off, 2} : bad; // c.lwsp
+        }
+    case 024:
+        if (!(h & 0x1000))
+        {
+            if (rs2) return {ADD, rd, 0, rs2, 0, 2};            // c.mv
+            return rd ? Insn{JALR, 0, rd, 0, 0, 2} : bad;       // c.jr
+        }
+        if (rs2) return {ADD, rd, rd, rs2, 0, 2};               // c.add
+        return rd ? Insn{JALR, 1, rd, 0, 0, 2} : Insn{EBREAK, 0, 0, 0, 0, 2};
+    case 026: return {SW, 0, 2, rs2, int32_t((h >> 7 & 0x3C) | (h >> 1 & 0xC0)), 2}; // c.swsp
+    default: return bad;
+    }
+}
+
+Cpu::Insn Cpu::fetch(uint32_t addr)
+{
+    uint32_t slot = code_slot(addr);
+    if (slot == UINT32_MAX || (addr & 1)) throw CpuFault("instruction fetch outside of code memory", addr);
+
+    bool cached = slot < flash_cache.size();
+    if (cached && flash_cache[slot].len) return flash_cache[slot];
+
+    uint32_t h = board.read(addr, 2);
+    Insn result = (h & 3) == 3 ? decode(h | board.read(addr + 2, 2) << 16) : decode16(h);
+    if (cached) flash_cache[slot] = result;
+    return result;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// CSR
+
+uint32_t Cpu::csr_read(uint32_t csr)
+{
+    switch(csr)
+    {
+    case 0x300: return mstatus;
+    case 0x301: return 0x40801105;      // RV32IMAC + X
+    case 0x305: return mtvec;
+    case 0x340: return mscratch;
+    case 0x341: return mepc;
+    case 0x342: return mcause;
+    case 0x343: return mtval;
+    case 0x800: return mstatus & 0x88;  // GINTENR
+    case 0x804: return intsyscr;
+    case 0xB00: case 0xC00: return uint32_t(board.now);
+    case 0xB80: case 0xC80: return uint32_t(board.now >> 32);
+    case 0xB02: case 0xC02: return uint32_t(instructions);
+    case 0xB82: case 0xC82: return uint32_t(instructions >> 32);
+    default: return other_csr[csr & 0xFFF];
+    }
+}
+
+void Cpu::csr_write(uint32_t csr, uint32_t value)
+{
+    switch(csr)
+    {
+    case 0x300: mstatus = value & 0x1888; break;
+    case 0x301: break;
+    case 0x305: mtvec = value; break;
+    case 0x340: mscratch = value; break;
+    case 0x341: mepc = value & ~1u; break;
+    case 0x342: mcause = value; break;
+    case 0x343: mtval = value; break;
+    case 0x800: mstatus = (mstatus & ~0x88u) | (value & 0x88); break;
+    case 0x804: intsyscr = value; break;
+    default: other_csr[csr & 0xFFF] = value; break;
+    }
+    board.pfic.changed = true;
+}
+
+//////////////////////////////////////////////////////////////////////////////////////////
+// Execution
+
+void Cpu::account(uint32_t addr, uint32_t cycles)
+{
+    board.now += cycles;
+    ++instructions;
+    slot_cycles[code_slot(addr)] += cycles;
+    if (frames.empty()) main_cycles += cycles;
+    else irq_stats[frames.back().irq].self_cycles += cycles;
+}
+
+void Cpu::take_interrupt(int irq)
+{
+    Frame f;
+    f.irq = irq;
+    f.mepc = mepc;
+    f.mcause = mcause;
+    f.mstatus = mstatus;
+    f.hpe = intsyscr & 1;
+    if (f.hpe) for(int i = 0; i < 16; ++i) f.regs[i] = x[hpe_regs[i]];
+    f.enter_time = board.now;
+    frames.push_back(f);
+
+    IrqStats& st = irq_stats[irq];
+    uint64_t latency = board.now - board.pfic.pend_since(irq);
+    ++st.count;
+    st.total_latency += latency;
+    st.max_latency = std::max(st.max_latency, latency);
+    board.pfic.enter(irq);
+
+    mepc = pc;
+    mcause = 0x80000000 | irq;
+    mstatus = (mstatus & ~0x88u) | (mstatus & 8) << 4 | 0x1800;
+    uint32_t base = mtvec & ~3u;
+    switch(mtvec & 3)
+    {
+    case 0: pc = base; break;
+    case 3: pc = board.read(base + 4 * irq, 4); break; // Table of absolute addresses
+    default: pc = base + 4 * irq; break;               // Table of jump instructions
+    }
+    sleeping = false;
+
+    board.now += cost.irq_entry;
+    st.self_cycles += cost.irq_entry;
+}
+
+void Cpu::mret()
+{
+    pc = mepc;
+    if (frames.empty())
+    {
+        // Not an interrupt return (startup code jumps to 'main' this way)
+        mstatus = (mstatus & ~0x88u) | (mstatus >> 4 & 8) | 0x80;
+        board.pfic.changed = true;
+        return;
+    }
+
+    const Frame& f = frames.back();
+    mepc = f.mepc;
+    mcause = f.mcause;
+    mstatus = f.mstatus;
+    if (f.hpe) for(int i = 0; i < 16; ++i) x[hpe_regs[i]] = f.regs[i];
+
+    IrqStats& st = irq_stats[f.irq];
+    uint64_t duration = board.now - f.enter_time;
+    st.total_duration += duration;
+    st.max_duration = std::max(st.max_duration, duration);
+    frames.pop_back();
+    board.pfic.exit(board.now);
+}
+
+void Cpu::step()
+{
+    Insn in = fetch(pc);
+    uint32_t next = pc + in.len;
+    uint32_t a = x[in.rs1], b = x[in.rs2];
+    uint32_t result = 0;
+    uint32_t cycles = cost.alu;
+    bool write_rd = true;
+    auto call = [&](uint32_t target)
+    {
+        if (in.rd == 1 || in.rd == 5)
+        {
+            uint32_t slot = code_slot(target);
+            if (slot != UINT32_MAX) ++slot_calls[slot];
+        }
+    };
+    auto branch = [&](bool taken)
+    {
+        write_rd = false;
+        if (!taken) return;
+        next = pc + in.imm;
+        cycles = cost.branch_taken;
+    };
+    auto load = [&](int size, bool sign)
+    {
+        result = board.read(a + in.imm, size);
+        if (sign) result = sext(result, 8 * size);
+        cycles = cost.load;
+    };
+    auto store = [&](int size)
+    {
+        board.write(a + in.imm, b, size);
+        cycles = cost.store;
+        write_rd = false;
+    };
+    auto amo = [&](uint32_t (*op)(uint32_t, uint32_t))
+    {
+        result = board.read(a, 4);
+        board.write(a, op(result, b), 4);
+        cycles = cost.atomic;
+    };
+
+    switch(in.op)
+    {
+    case LUI:   result = in.imm; break;
+    case AUIPC: result = pc + in.imm; break;
+    case JAL:
+        result = next;
+        next = pc + in.imm;
+        cycles = cost.jump;
+        call(next);
+        break;
+    case JALR:
+        result = next;
+        next = (a + in.imm) & ~1u;
+        cycles = cost.jump_reg;
+        call(next);
+        break;
+
+    case BEQ:   branch(a == b); break;
+    case BNE:   branch(a != b); break;
+    case BLT:   branch(int32_t(a) < int32_t(b)); break;
+    case BGE:   branch(int32_t(a) >= int32_t(b)); break;
+    case BLTU:  branch(a < b); break;
+    case BGEU:  branch(a >= b); break;
+
+    case LB:    load(1, true); break;
+    case LH:    load(2, true); break;
+    case LW:    load(4, false); break;
+    case LBU:   load(1, false); break;
+    case LHU:   load(2, false); break;
+    case SB:    store(1); break;
+    case SH:    store(2); break;
+    case SW:    store(4); break;
+
+    case ADDI:  result = a + in.imm; break;
+    case SLTI:  result = int32_t(a) < in.imm; break;
+    case SLTIU: result = a < uint32_t(in.imm); break;
+    case XORI:  result = a ^ in.imm; break;
+    case ORI:   result = a | in.imm; break;
+    case ANDI:  result = a & in.imm; break;
+    case SLLI:  result = a << in.imm; break;
+    case SRLI:  result = a >> in.imm; break;
+    case SRAI:  result = int32_t(a) >> in.imm; break;
+
+    case ADD:   result = a + b; break;
+    case SUB:   result = a - b; break;
+    case SLL:   result = a << (b & 31); break;
+    case SLT:   result = int32_t(a) < int32_t(b); break;
+    case SLTU:  result = a < b; break;
+    case XOR:   result = a ^ b; break;
+    case SRL:   result = a >> (b & 31); break;
+    case SRA:   result = int32_t(a) >> (b & 31); break;
+    case OR:    result = a | b; break;
+    case AND:   result = a & b; break;
+
+    case MUL:    result = a * b; cycles = cost.mul; break;
+    case MULH:   result = uint32_t((int64_t(int32_t(a)) * int32_t(b)) >> 32); cycles = cost.mul; break;
+    case MULHSU: result = uint32_t((int64_t(int32_t(a)) * int64_t(b)) >> 32); cycles = cost.mul; break;
+    case MULHU:  result = uint32_t((uint64_t(a) * b) >> 32); cycles = cost.mul; break;
+    case DIV:
+        cycles = cost.div;
+        if (!b) result = UINT32_MAX;
+        else if (a == 0x80000000 && b == UINT32_MAX) result = a;
+        else result = int32_t(a) / int32_t(b);
+        break;
+    case DIVU:
+        cycles = cost.div;
+        result = b ? a / b : UINT32_MAX;
+        break;
+    case REM:
+        cycles = cost.div;
+        if (!b) result = a;
+        else if (a == 0x80000000 && b == UINT32_MAX) result = 0;
+        else result = int32_t(a) % int32_t(b);
+        break;
+    case REMU:
+        cycles = cost.div;
+        result = b ? a % b : a;
+        break;
+
+    case LR:
+        result = board.read(a, 4);
+        reservation = a;
+        cycles = cost.atomic;
+        break;
+    case SC:
+        result = reservation != a;
+        if (!result) board.write(a, b, 4);
+        reservation = UINT32_MAX;
+        cycles = cost.atomic;
+        break;
+    case AMOSWAP: amo([](uint32_t, uint32_t v) {return v;}); break;
+    case AMOADD:  amo([](uint32_t m, uint32_t v) {return m + v;}); break;
+    case AMOXOR:  amo([](uint32_t m, uint32_t v) {return m ^ v;}); break;
+    case AMOAND:  amo([](uint32_t m, uint32_t v) {return m & v;}); break;
+    case AMOOR:   amo([](uint32_t m, uint32_t v) {return m | v;}); break;
+    case AMOMIN:  amo([](uint32_t m, uint32_t v) {return int32_t(m) < int32_t(v) ? m : v;}); break;
+    case AMOMAX:  amo([](uint32_t m, uint32_t v) {return int32_t(m) > int32_t(v) ? m : v;}); break;
+    case AMOMINU: amo([](uint32_t m, uint32_t v) {return std::min(m, v);}); break;
+    case AMOMAXU: amo([](uint32_t m, uint32_t v) {return std::max(m, v);}); break;
+
+    case FENCE: write_rd = false; break;
+    case WFI:
+        write_rd = false;
+        sleeping = true;
+        board.pfic.changed = true; // Check wakeup condition before going to sleep
+        break;
+    case MRET:
+        account(pc, cost.irq_exit);
+        mret();
+        return;
+
+    case CSRRW: case CSRRWI:
+        {
+            uint32_t value = in.op == CSRRW ? a : in.rs1;
+            if (in.rd) result = csr_read(in.imm);
+            csr_write(in.imm, value);
+            break;
+        }
+    case CSRRS: case CSRRC: case CSRRSI: case CSRRCI:
+        {
+            uint32_t value = in.op == CSRRS || in.op == CSRRC ? a : in.rs1;
+            result = csr_read(in.imm);
+            if (in.rs1) csr_write(in.imm, in.op == CSRRS || in.op == CSRRSI ? result | value : result & ~value);
+            break;
+        }
+
+    case ECALL:  throw CpuFault("ecall", pc);
+    case EBREAK: throw CpuFault("ebreak", pc);
+    default:
+        {
+            char msg[64];
+            uint32_t word = board.read(pc, in.len);
+            snprintf(msg, sizeof(msg), "illegal instruction %0*X", 2 * in.len, word);
+            throw CpuFault(msg, pc);
+        }
+    }
+
+    if (write_rd && in.rd) x[in.rd] = result;
+    account(pc, cycles);
+    pc = next;
+}
+
+void Cpu::run(uint64_t until)
+{
+    while(board.now < until)
+    {
+        if (board.now >= board.next_event) board.process_events();
+        if (board.pfic.changed)
+        {
+            board.pfic.changed = false;
+            next_irq = board.pfic.select(mstatus & 8, intsyscr & 2);
+            if (board.pfic.wakeup()) sleeping = false;
+        }
+        if (next_irq >= 0)
+        {
+            take_interrupt(next_irq);
+            next_irq = -1;
+            continue;
+        }
+        if (sleeping)
+        {
+            uint64_t wake = std::min(board.next_event, until);
+            sleep_cycles += wake - board.now;
+            board.now = wake;
+            continue;
+        }
+        step();
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <stdexcept>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "board.h"
+
+/*
+    Cycle costs of instruction classes. QingKe V4B timings are not published in detail, these are approximations
+    of its 3-stage single issue pipeline (taken branches refill fetch, iterative divider).
+    Good for comparison of firmware versions and budgets, not cycle exact.
+*/
+struct CostModel {
+    uint32_t alu = 1;
+    uint32_t load = 2;
+    uint32_t store = 1;
+    uint32_t branch_taken = 3;
+    uint32_t jump = 2;          // jal
+    uint32_t jump_reg = 3;      // jalr
+    uint32_t mul = 1;
+    uint32_t div = 17;
+    uint32_t atomic = 3;
+    uint32_t irq_entry = 6;     // Hardware prologue (HPE) saves registers in parallel with vector fetch
+    uint32_t irq_exit = 4;      // mret
+};
+
+// Exception in firmware (illegal instruction, bad access, ebreak...). Emulation stops
+struct CpuFault : std::runtime_error {
+    uint32_t pc;
+
+    CpuFault(const std::string& what, uint32_t pc) : std::runtime_error(what), pc(pc) {}
+};
+
+/*
+    QingKe V4B core: RV32IMAC, machine mode only, WCH interrupt extensions:
+      - vector table of handler addresses (mtvec mode 3)
+      - hardware prologue/epilogue (INTSYSCR.HWSTKEN): caller-saved registers are saved on interrupt entry
+        and restored by 'mret', so handlers with 'WCH-Interrupt-fast' attribute do not save them
+      - nesting by preemption priority (INTSYSCR.INESTEN)
+      - CSR 0x800 (GINTENR) - alias of MIE/MPIE bits of mstatus
+    WCH "XW" compressed extension is not supported - firmware is built without it ('rvemu' configuration, -march=rv32imac).
+*/
+class Cpu {
+public:
+    struct IrqStats {
+        uint32_t count = 0;
+        uint64_t self_cycles = 0;       // Handler code (nested interrupts excluded)
+        uint64_t total_latency = 0;     // From pending to handler entry
+        uint64_t max_latency = 0;
+        uint64_t total_duration = 0;    // From entry to 'mret' (nested interrupts included)
+        uint64_t max_duration = 0;
+    };
+
+    Cpu(Board& board, uint32_t reset_pc);
+
+    void run(uint64_t until); // Run until board time reaches 'until'. Throws CpuFault
+
+    CostModel cost;
+    uint32_t pc;
+    uint32_t x[32] = {};
+
+    // Profile
+    static constexpr uint32_t code_slots = (Board::flash_size + Board::ram_size) / 2;
+    static uint32_t code_slot(uint32_t addr);   // Index of code halfword (flash, then RAM), UINT32_MAX if not code memory
+    static uint32_t slot_addr(uint32_t slot);
+
+    std::vector<uint64_t> slot_cycles;          // Cycles of instructions at this address
+    std::vector<uint32_t> slot_calls;           // Calls (jal/jalr with link register) to this address
+    IrqStats irq_stats[Pfic::irqs];
+    uint64_t main_cycles = 0;                   // Outside of interrupts (sleep excluded)
+    uint64_t sleep_cycles = 0;                  // In WFI
+    uint64_t instructions = 0;
+
+private:
+    struct Insn {
+        uint8_t op;
+        uint8_t rd, rs1, rs2;
+        int32_t imm;
+        uint8_t len;                            // 2 or 4, 0 - not decoded yet (decode cache)
+    };
+
+    // Interrupt context: state saved by hardware on entry
+    struct Frame {
+        int irq;
+        uint32_t mepc, mcause, mstatus;
+        bool hpe;
+        uint32_t regs[16];                      // x1, x5-x7, x10-x17, x28-x31
+        uint64_t enter_time;
+    };
+
+    Board& board;
+    std::vector<Insn> flash_cache;
+    std::vector<Frame> frames;
+    uint32_t mstatus = 0, mtvec = 0, mepc = 0, mcause = 0, mtval = 0, mscratch = 0;
+    uint32_t intsyscr = 0;
+    uint32_t other_csr[4096] = {};
+    uint32_t reservation = UINT32_MAX;          // LR/SC
+    bool sleeping = false;
+    int next_irq = -1;
+
+    static Insn decode(uint32_t word);
+    static Insn decode16(uint32_t h);
+    Insn fetch(uint32_t addr);
+    void step();
+    void take_interrupt(int irq);
+    void mret();
+    uint32_t csr_read(uint32_t csr);
+    void csr_write(uint32_t csr, uint32_t value);
+    void account(uint32_t addr, uint32_t cycles);
+};
@@ -0,0 +1,165 @@
+#include <algorithm>
+#include <cxxabi.h>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <stdlib.h>
+#include <string.h>
+
+#include "elf_image.h"
+
+namespace {
+
+// ELF32 structures (only fields we use are named)
+struct Elf32Header {
+    uint8_t  ident[16];
+    uint16_t type;
+    uint16_t machine;
+    uint32_t version;
+    uint32_t entry;
+    uint32_t phoff;
+    uint32_t shoff;
+    uint32_t flags;
+    uint16_t ehsize;
+    uint16_t phentsize;
+    uint16_t phnum;
+    uint16_t shentsize;
+    uint16_t shnum;
+    uint16_t shstrndx;
+};
+
+struct Elf32ProgramHeader {
+    uint32_t type;
+    uint32_t offset;
+    uint32_t vaddr;
+    uint32_t paddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    uint32_t flags;
+    uint32_t align;
+};
+
+struct Elf32SectionHeader {
+    uint32_t name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t addr;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t link;
+    uint32_t info;
+    uint32_t addralign;
+    uint32_t entsize;
+};
+
+struct Elf32Symbol {
+    uint32_t name;
+    uint32_t value;
+    uint32_t size;
+    uint8_t  info;
+    uint8_t  other;
+    uint16_t shndx;
+};
+
+constexpr uint16_t EM_RISCV = 243;
+constexpr uint32_t PT_LOAD = 1;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHF_EXECINSTR = 4;
+constexpr uint8_t  STT_NOTYPE = 0;
+constexpr uint8_t  STT_FUNC = 2;
+
+std::string demangle(const char* name)
+{
+    int status = 0;
+    char* result = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+    if (!result) return name;
+    std::string str = result;
+    free(result);
+    return str;
+}
+
+template<class T>
+const T& at(const std::vector<uint8_t>& file, uint32_t offset, uint32_t idx = 0)
+{
+    uint64_t pos = offset + uint64_t(idx) * sizeof(T);
+    if (pos + sizeof(T) > file.size()) throw std::runtime_error("truncated ELF file");
+    return *reinterpret_cast<const T*>(file.data() + pos);
+}
+
+} // namespace
+
+ElfImage::ElfImage(const std::string& file_name)
+{
+    std::ifstream in(file_name, std::ios::binary);
+    if (!in) throw std::runtime_error("can't open " + file_name);
+    std::vector<uint8_t> file((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+    const auto& hdr = at<Elf32Header>(file, 0);
+    if (memcmp(hdr.ident, "\x7F" "ELF", 4) || hdr.ident[4] != 1 || hdr.ident[5] != 1)
+        throw std::runtime_error(file_name + ": not a 32-bit little endian ELF file");
+    if (hdr.machine != EM_RISCV) throw std::runtime_error(file_name + ": not a RISC-V executable");
+    entry_point = hdr.entry;
+
+    for(int i = 0; i < hdr.phnum; ++i)
+    {
+        const auto& ph = at<Elf32ProgramHeader>(file, hdr.phoff, i);
+        if (ph.type != PT_LOAD || !ph.filesz) continue;
+        if (uint64_t(ph.offset) + ph.filesz > file.size()) throw std::runtime_error("truncated ELF file");
+        segs.push_back({ph.paddr, std::vector<uint8_t>(file.begin() + ph.offset, file.begin() + ph.offset + ph.filesz)});
+    }
+
+    // Functions: typed symbols and code labels (startup is assembler, its labels have no type)
+    std::map<uint32_t, uint32_t> section_end; // Label address -> end of its section (limit for size of label)
+    for(int i = 0; i < hdr.shnum; ++i)
+    {
+        const auto& sh = at<Elf32SectionHeader>(file, hdr.shoff, i);
+        if (sh.type != SHT_SYMTAB) continue;
+        const auto& strtab = at<Elf32SectionHeader>(file, hdr.shoff, sh.link);
+        for(uint32_t s = 1; s < sh.size / sizeof(Elf32Symbol); ++s)
+        {
+            const auto& sym = at<Elf32Symbol>(file, sh.offset, s);
+            uint8_t type = sym.info & 0xF;
+            if (type != STT_FUNC && type != STT_NOTYPE) continue;
+            if (!sym.shndx || sym.shndx >= hdr.shnum) continue;
+            const auto& code = at<Elf32SectionHeader>(file, hdr.shoff, sym.shndx);
+            if (!(code.flags & SHF_EXECINSTR)) continue;
+            if (sym.name >= strtab.size) continue;
+            const char* name = reinterpret_cast<const char*>(file.data() + strtab.offset + sym.name);
+            if (!*name || name[0] == '$' || !strncmp(name, ".L", 2)) continue; // Mapping symbols and local labels
+            funcs.push_back({sym.value & ~1u, type == STT_FUNC ? sym.size : 0, demangle(name)});
+            section_end[sym.value & ~1u] = code.addr + code.size;
+        }
+    }
+
+    // Sort by address, sized symbols first (so alias without size is dropped), then fill gaps
+    std::stable_sort(funcs.begin(), funcs.end(), [](const Symbol& a, const Symbol& b)
+    {
+        return a.addr != b.addr ? a.addr < b.addr : a.size > b.size;
+    });
+    funcs.erase(std::unique(funcs.begin(), funcs.end(), [](const Symbol& a, const Symbol& b) {return a.addr == b.addr;}), funcs.end());
+    for(size_t i = 0; i < funcs.size(); ++i)
+    {
+        if (funcs[i].size) continue;
+        uint32_t end = section_end[funcs[i].addr];
+        if (i + 1 < funcs.size()) end = std::min(end, funcs[i+1].addr);
+        funcs[i].size = end - funcs[i].addr;
+    }
+}
+
+const ElfImage::Symbol* ElfImage::find(uint32_t addr) const
+{
+    auto it = std::upper_bound(funcs.begin(), funcs.end(), addr, [](uint32_t a, const Symbol& s) {return a < s.addr;});
+    if (it == funcs.begin()) return nullptr;
+    --it;
+    return addr - it->addr < it->size ? &*it : nullptr;
+}
+
+const ElfImage::Symbol* ElfImage::find(const std::string& name) const
+{
+    for(auto& s: funcs)
+    {
+        if (s.name == name) return &s;
+    }
+    return nullptr;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/*
+    Firmware image: loadable segments of ELF32 (RISC-V, little endian) and its function symbols.
+    Segments are placed by physical (load) address, as programmer writes them to flash -
+    startup code copies '.data' to RAM itself.
+*/
+class ElfImage {
+public:
+    struct Segment {
+        uint32_t addr;
+        std::vector<uint8_t> data;
+    };
+
+    struct Symbol {
+        uint32_t addr;
+        uint32_t size;
+        std::string name; // Demangled
+    };
+
+    // Throws std::runtime_error if file can't be loaded
+    explicit ElfImage(const std::string& file_name);
+
+    uint32_t entry() const {return entry_point;}
+    const std::vector<Segment>& segments() const {return segs;}
+    const std::vector<Symbol>& functions() const {return funcs;} // Sorted by address, sizes cover gaps up to next symbol (or section end)
+
+    const Symbol* find(uint32_t addr) const;        // Function containing 'addr' (nullptr if none)
+    const Symbol* find(const std::string& name) const;
+
+private:
+    uint32_t entry_point = 0;
+    std::vector<Segment> segs;
+    std::vector<Symbol> funcs;
+};
@@ -0,0 +1,234 @@
+/*
+    Full-system emulator of Tetris board: runs firmware ELF (RV32IMAC) on model of CH32V203 with its LED matrix
+    and prints where CPU cycles go - main loop, interrupts, sleep, hottest functions - plus scan health and
+    checksum of displayed images (for regression checks of firmware changes without hardware).
+
+    Usage:
+      rvemu <firmware.elf> [ms=1000] [<ms>:<keys>]... [-v]
+        <ms>:<keys> - from time 'ms' hold 'keys': '+' separated list of left, down, right, up, hit, 1, 2, 3
+                      (empty list releases all keys), e.g. rvemu tetris.elf 5000 1000:hit 1100: 2000:left+down
+        -v          - print LED image on each change
+
+    Firmware must be built for rv32imac and with the same PIXEL_BITPLANES as this tool: use 'rvemu' configuration of
+    target project (same as production 'obj', but without WCH XW extension).
+*/
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "board.h"
+#include "cpu.h"
+#include "elf_image.h"
+#include "interface.h"
+
+struct KeyScript {
+    uint64_t time;
+    uint8_t keys;
+};
+
+static const char* key_names[8] = {"left", "down", "right", "up", "3", "hit", "2", "1"}; // Bit N - PA<N>
+
+static bool parse_keys(const char* arg, KeyScript& event)
+{
+    char* end;
+    unsigned long ms = strtoul(arg, &end, 10);
+    if (end == arg || *end != ':') return false;
+    event.time = uint64_t(ms) * (Board::hclk / 1000);
+    event.keys = 0;
+    for(const char* p = end + 1; *p;)
+    {
+        size_t len = strcspn(p, "+");
+        int key = 0;
+        while(key < 8 && (strlen(key_names[key]) != len || strncmp(p, key_names[key], len))) ++key;
+        if (key == 8) return false;
+        event.keys |= 1 << key;
+        p += len;
+        if (*p) ++p;
+    }
+    return true;
+}
+
+static void print_image(const LedMatrix::Image& img)
+{
+    for(int y = 0; y < 16; ++y)
+    {
+        for(int x = 0; x < 8; ++x)
+        {
+            int v = img.br[y][x];
+            putchar(v ? "0123456789ABCDEF"[(v * 15 + max_br / 2) / max_br] : '.');
+        }
+        putchar('\n');
+    }
+}
+
+static double percent(uint64_t part, uint64_t total) {return total ? 100.0 * part / total : 0;}
+static double to_us(double cycles) {return cycles * 1e6 / Board::hclk;}
+
+// Frame statistics, collected on DMA1 Ch6 frame boundaries (first row word of frame)
+struct FrameStats {
+    uint32_t frames = 0;
+    uint32_t changes = 0;
+    uint32_t no_sleep = 0;  // Frames where CPU never slept
+    double total_load = 0;
+    double max_load = 0;
+    uint32_t checksum = 2166136261u; // FNV-1a of all displayed frames
+    uint64_t last_time = 0;
+    uint64_t last_sleep = 0;
+    LedMatrix::Image image = {};
+};
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: rvemu <firmware.elf> [ms=1000] [<ms>:<keys>]... [-v]\n");
+        return 1;
+    }
+
+    uint64_t run_ms = 1000;
+    bool verbose = false;
+    std::vector<KeyScript> keys;
+    for(int i = 2; i < argc; ++i)
+    {
+        KeyScript ev;
+        if (!strcmp(argv[i], "-v")) verbose = true;
+        else if (parse_keys(argv[i], ev)) keys.push_back(ev);
+        else if (i == 2 && atoi(argv[i]) > 0) run_ms = atoi(argv[i]);
+        else
+        {
+            fprintf(stderr, "Bad argument '%s'\n", argv[i]);
+            return 1;
+        }
+    }
+    std::stable_sort(keys.begin(), keys.end(), [](const KeyScript& a, const KeyScript& b) {return a.time < b.time;});
+
+    try
+    {
+        ElfImage elf(argv[1]);
+        Board board(elf);
+        Cpu cpu(board, elf.entry());
+
+        FrameStats fs;
+        board.dma.on_transfer = [&](int channel, uint32_t index, uint64_t time)
+        {
+            if (channel != 6 || index) return;
+            LedMatrix::Image img;
+            if (!board.leds.frame(time, max_br, img)) return;
+            double load = fs.last_time ? 1 - double(cpu.sleep_cycles - fs.last_sleep) / (time - fs.last_time) : 0;
+            if (fs.last_time)
+            {
+                ++fs.frames;
+                fs.total_load += load;
+                fs.max_load = std::max(fs.max_load, load);
+                if (cpu.sleep_cycles == fs.last_sleep) ++fs.no_sleep;
+            }
+            fs.last_time = time;
+            fs.last_sleep = cpu.sleep_cycles;
+            for(auto& line: img.br) for(uint8_t v: line) fs.checksum = (fs.checksum ^ v) * 16777619u;
+            if (img == fs.image) return;
+            fs.image = img;
+            ++fs.changes;
+            if (!verbose) return;
+            printf("--- %.3f ms\n", time * 1000.0 / Board::hclk);
+            print_image(img);
+        };
+
+        uint64_t end = run_ms * (Board::hclk / 1000);
+        auto start = std::chrono::steady_clock::now();
+        try
+        {
+            for(auto& ev: keys)
+            {
+                if (ev.time >= end) break;
+                cpu.run(ev.time);
+                board.set_buttons(ev.keys);
+            }
+            cpu.run(end);
+        }
+        catch(const CpuFault& fault)
+        {
+            auto sym = elf.find(fault.pc);
+            printf("CPU fault at %08X (%s) after %.3f ms: %s\n", fault.pc, sym ? sym->name.c_str() : "?",
+                   board.now * 1000.0 / Board::hclk, fault.what());
+        }
+        double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        uint64_t cycles = board.now;
+        uint64_t irq_cycles = cycles - cpu.main_cycles - cpu.sleep_cycles;
+        printf("Simulated %.3f ms (%llu cycles, %llu instructions) in %.2f s, %.1f MIPS\n", cycles * 1000.0 / Board::hclk,
+               (unsigned long long)cycles, (unsigned long long)cpu.instructions, wall, cpu.instructions / wall / 1e6);
+        printf("CPU: main %.2f%%, interrupts %.2f%%, sleep %.2f%%\n",
+               percent(cpu.main_cycles, cycles), percent(irq_cycles, cycles), percent(cpu.sleep_cycles, cycles));
+        printf("Frames: %u (%u changes), load avg %.2f%% max %.2f%%, %u without sleep\n", fs.frames, fs.changes,
+               fs.frames ? 100 * fs.total_load / fs.frames : 0., 100 * fs.max_load, fs.no_sleep);
+        printf("Scan overruns: DMA TC %u/%u/%u (ch2/3/6), SPI1 TX %u, SPI2 TX %u RX %u\n",
+               board.dma.ch[1].tc_overruns, board.dma.ch[2].tc_overruns, board.dma.ch[5].tc_overruns,
+               board.spi1.tx_overruns, board.spi2.tx_overruns, board.spi2.rx_overruns);
+        if (board.flash_writes) printf("Flash writes (ignored): %u\n", board.flash_writes);
+        printf("LED checksum: %08X\n", fs.checksum);
+
+        // Interrupts: names of handlers from vector table
+        auto vectors = elf.find("_vector_base");
+        printf("\n%-28s %8s %7s %12s %12s %12s %12s\n", "Interrupt", "count", "cpu %", "lat avg us", "lat max us",
+               "dur avg us", "dur max us");
+        for(int irq = 0; irq < Pfic::irqs; ++irq)
+        {
+            const Cpu::IrqStats& st = cpu.irq_stats[irq];
+            if (!st.count) continue;
+            std::string name = "IRQ " + std::to_string(irq);
+            if (vectors)
+            {
+                auto handler = elf.find(board.read(vectors->addr + 4 * irq, 4));
+                if (handler) name = handler->name;
+            }
+            printf("%-28s %8u %7.2f %12.2f %12.2f %12.2f %12.2f\n", name.c_str(), st.count, percent(st.self_cycles, cycles),
+                   to_us(double(st.total_latency) / st.count), to_us(st.max_latency),
+                   to_us(double(st.total_duration) / st.count), to_us(st.max_duration));
+        }
+
+        // Functions by self cycles
+        struct FuncStats {
+            uint64_t cycles = 0;
+            uint32_t calls = 0;
+        };
+        std::map<const ElfImage::Symbol*, FuncStats> funcs;
+        uint64_t unknown = 0;
+        for(uint32_t slot = 0; slot < Cpu::code_slots; ++slot)
+        {
+            if (!cpu.slot_cycles[slot] && !cpu.slot_calls[slot]) continue;
+            auto sym = elf.find(Cpu::slot_addr(slot));
+            if (!sym)
+            {
+                unknown += cpu.slot_cycles[slot];
+                continue;
+            }
+            funcs[sym].cycles += cpu.slot_cycles[slot];
+            funcs[sym].calls += cpu.slot_calls[slot];
+        }
+        std::vector<std::pair<const ElfImage::Symbol*, FuncStats>> top(funcs.begin(), funcs.end());
+        std::sort(top.begin(), top.end(), [](const auto& a, const auto& b) {return a.second.cycles > b.second.cycles;});
+        if (top.size() > 25) top.resize(25);
+        printf("\n%-40s %7s %10s %14s\n", "Function", "cpu %", "calls", "cycles/call");
+        for(auto& f: top)
+        {
+            std::string name = f.first->name.size() > 40 ? f.first->name.substr(0, 37) + "..." : f.first->name;
+            printf("%-40s %7.2f %10u %14.1f\n", name.c_str(), percent(f.second.cycles, cycles), f.second.calls,
+                   f.second.calls ? double(f.second.cycles) / f.second.calls : 0.);
+        }
+        if (unknown) printf("%-40s %7.2f\n", "(no symbol)", percent(unknown, cycles));
+
+        printf("\nLast image:\n");
+        print_image(fs.image);
+    }
+    catch(const std::exception& e)
+    {
+        fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
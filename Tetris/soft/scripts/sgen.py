@@ -15,20 +15,23 @@ class Sprite:
             pixels.append(''.join(slc)[::-1])
         return Sprite(pixels, self.palete, self.name)
 
+    # Rows are packed in byte lanes (row Y in bits 8*Y..8*Y+7) - same layout as 'Bitboard' word
     def get_pixels(self) -> tuple[int, int]:
+        assert len(self.pixels) <= 4 and len(self.pixels[0]) <= 8, f'Sprite {"\n".join(self.pixels)} is too big (max 8x4)'
         pixels1 = 0
         pixels2 = 0
-        mask = 1
-        for sym in ''.join(self.pixels):
-            if sym != ' ':
-                if self.palete:
-                    idx = self.palete.find(sym)
-                    assert idx != -1, f'Symbol {sym} of sprite {"\n".join(self.pixels)} not found in sprite palete {self.palete}'
-                    if idx != 1: pixels1 |= mask
-                    if idx != 0: pixels2 |= mask
-                else:
-                    pixels1 |= mask
-            mask <<= 1
+        for y, line in enumerate(self.pixels):
+            mask = 1 << (y*8)
+            for sym in line:
+                if sym != ' ':
+                    if self.palete:
+                        idx = self.palete.find(sym)
+                        assert idx != -1, f'Symbol {sym} of sprite {"\n".join(self.pixels)} not found in sprite palete {self.palete}'
+                        if idx != 1: pixels1 |= mask
+                        if idx != 0: pixels2 |= mask
+                    else:
+                        pixels1 |= mask
+                mask <<= 1
         return pixels1, pixels2
 
     @property
@@ -124,6 +127,21 @@ class Parser:
                 print('// ' + '\n// '.join(spr.pixels))
                 print(spr)
 
+    # Sprite pixels moved to column X (X - width/2 is left column), one row of 8 values per SpriteDef.
+    # 0 - sprite does not fit in field at this column
+    def print_columns(self):
+        print('const uint32_t sprite_columns[][8] = {')
+        for spr in self.sprites:
+            if spr:
+                width = len(spr.pixels[0])
+                for pixels in spr.get_pixels()[:2 if spr.palete else 1]:
+                    columns = []
+                    for x in range(8):
+                        left = x - width // 2
+                        columns.append(f'0x{pixels << left:X}' if left >= 0 and left + width <= 8 else '0')
+                    print(f'  {{{", ".join(columns)}}},')
+        print('};')
+
     def print_logos(self):
         idxs = []
         print('const uint8_t logos[] = {')
@@ -201,17 +219,15 @@ print('''#include "sprite.h"
 const SpriteDef sprites[] = {''')
 spr.print_sprites()
 print('};')
+spr.print_columns()
 spr.print_logos()
 print(f'const int tetris_figures[] = {{{spr.get_tetris_array()}}};')
 
 with open('spr_defs.h', 'wt') as f:
     print('#pragma once', file=f)
     print(f'constexpr int total_tetris_figures = {len(spr.tetris_indexes)};', file=f)
-    print('enum Logos {', file=f)
-    for icon in spr.logos:
-        if icon.name:
-            print(f'  Logo_{icon.name},', file=f)
-    print('  LogosTotal\n};', file=f)
+    # Logo animations (in order of '%logo' entries, see 'logos_entries'). Games refer them from registry (tmain.cpp)
+    print(f'constexpr int total_logos = {sum(1 for icon in spr.logos if icon.name)};', file=f)
     spr.print_sprite_names(f)
 
 
@@ -0,0 +1,49 @@
+# Convert timeline dump (see 'timeline.h') to Chrome trace event JSON (open in chrome://tracing or ui.perfetto.dev)
+# Usage: timeline2json.py <log file or - for stdin> [output.json]
+# Log may contain other lines (debug USART capture of firmware built with TIMELINE_DUMP=1); last 'TIMELINE' ... 'END' block is converted
+import json
+import sys
+
+src = sys.stdin if sys.argv[1] == '-' else open(sys.argv[1], 'rt', errors='replace')
+block = None
+result = None
+for line in src:
+    line = line.strip()
+    if line.startswith('TIMELINE '):
+        block = [line]
+    elif block is not None:
+        block.append(line)
+        if line == 'END':
+            result, block = block, None
+if result is None:
+    sys.exit('No timeline found')
+
+cycles_per_us = int(result[0].split()[2])
+points = {}
+events = []
+time = None
+for line in result[1:-1]:
+    fields = line.split()
+    if fields[0] == 'P':
+        points[int(fields[1])] = (fields[3], int(fields[2]))
+    elif fields[0] == 'R':
+        raw = int(fields[1], 16)
+        # Unwrap 32-bit counter (records of interrupts may be slightly out of order)
+        if time is None:
+            time = raw
+        else:
+            delta = (raw - time) & 0xFFFFFFFF
+            time += delta - (1 << 32) if delta >= 1 << 31 else delta
+        name, isr = points[int(fields[2])]
+        events.append({'name': name, 'ph': fields[3], 'ts': time / cycles_per_us, 'pid': 0, 'tid': isr})
+
+if events:
+    start = min(e['ts'] for e in events)
+    for e in events:
+        e['ts'] = round(e['ts'] - start, 3)
+events += [
+    {'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': 0, 'args': {'name': 'main loop'}},
+    {'name': 'thread_name', 'ph': 'M', 'pid': 0, 'tid': 1, 'args': {'name': 'interrupts'}},
+]
+out = open(sys.argv[2], 'wt') if len(sys.argv) > 2 else sys.stdout
+json.dump({'traceEvents': events, 'displayTimeUnit': 'ns'}, out)
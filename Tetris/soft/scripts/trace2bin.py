@@ -0,0 +1,27 @@
+# Extract input traces from debug USART log of device (firmware built with TRACE_DUMP=1, see 'trace_save' in platform.cpp)
+# Usage: trace2bin.py <log file> [output prefix]
+# Every 'TRACE <size>' ... 'END' block is written to <prefix><N>.rwt
+import sys
+
+prefix = sys.argv[2] if len(sys.argv) > 2 else 'trace_'
+count = 0
+data = None
+size = 0
+with open(sys.argv[1], 'rt', errors='replace') as f:
+    for line in f:
+        line = line.strip()
+        if line.startswith('TRACE '):
+            data = bytearray()
+            size = int(line.split()[1])
+        elif line == 'END' and data is not None:
+            if len(data) != size:
+                print(f'Trace {count}: expected {size} bytes, got {len(data)}. Skipped')
+            else:
+                name = f'{prefix}{count}.rwt'
+                with open(name, 'wb') as out:
+                    out.write(data)
+                print(f'{name}: {size} bytes')
+            count += 1
+            data = None
+        elif data is not None:
+            data += bytes.fromhex(line)
@@ -43,7 +43,7 @@ int main(void)
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_1);
     SystemCoreClockUpdate();
  //   Delay_Init();
- //   USART_Printf_Init(115200);
+    USART_Printf_Init(115200); // Debug output (traces)
  //   printf("SystemClk:%d\r\n", SystemCoreClock);
  //   printf( "ChipID:%08x\r\n", DBGMCU_GetCHIPID() );
  //   printf("This is printf example\r\n");
@@ -1,19 +1,50 @@
+#include <stdio.h>
 #include <utility>
 
 #include "../common/interface.h"
+#include "../common/key_queue.h"
+#include "../common/trace.h"
+#include "../common/timeline.h"
+#include "../common/isr_stats.h"
+#include "../common/vscreen.h"
 #include "ch32v20x.h"
 #include "../Core/core_riscv.h"
 
-static Pixels  working_pixels; // Copy of pixels to output to LED
-static uint8_t col_index;     // Column index (scans by them) 0-7
-static uint8_t phase;         // Scan phase: 0-2. In phase 0 pixels from 'br1' emited, in phase 1 pixels from 'br2' emited, in phase 2 no pixel update performed, so 'br2' still intact
-
 static uint8_t cur_keys;      // Real current state of pressed keys
-static uint8_t changed_keys;  // All keys which state changed from 'cur_keys' during current scan cycle
-static uint8_t debounce;      // Debounce downcounter. If not zero all key scan suppressed
-static uint8_t active_keys;   // Copy of 'cur_keys' but with posibility to top level code shut down separate bits from 1 to 0 (depress them)
 
-static constexpr int debounce_time = 5; // How many full scans perform before unlocking keyboard
+static constexpr int debounce_time = 5; // How many full scans perform before unlocking key after its change
+static_assert(debounce_time < 8, "Debounce counter is 3 bits wide");
+
+/*
+    Per key debounce downcounters, 'vertical' layout: bit N of 'cnt[i]' is bit i of counter for key N.
+    Key with nonzero counter is locked (its changes ignored), other keys are scanned independently.
+    All 8 keys are processed by same bit operations, so cost is constant.
+*/
+static uint8_t debounce[3];
+
+// Process new keys sample. Returns bitset of accepted changes
+static uint8_t debounce_keys(uint8_t sample)
+{
+    uint8_t locked = debounce[0] | debounce[1] | debounce[2];
+    uint8_t changed = (cur_keys ^ sample) & ~locked;
+    cur_keys ^= changed;
+
+    // Decrement locked counters (borrow chain)
+    uint8_t borrow = locked;
+    for(auto& bit: debounce)
+    {
+        uint8_t next_borrow = borrow & ~bit;
+        bit ^= borrow;
+        borrow = next_borrow;
+    }
+
+    // Load 'debounce_time' into counters of changed keys
+    for(int i=0; i<3; ++i)
+    {
+        debounce[i] = (debounce[i] & ~changed) | (debounce_time & (1 << i) ? changed : 0);
+    }
+    return changed;
+}
 
 static uint16_t led_voltage[10];  // LED voltage DMA buffer (2 x 1+4 samples accumulated)
 static uint8_t  leds_to_sample;   // Bitset of LED to sample. Bit 0 - samle high LED cluster, bit 1 - sample low LED cluster
@@ -29,7 +60,136 @@ enum class LEDVoltageReq : uint8_t {
 
 static volatile LEDVoltageReq request_led_voltages; // Current LED sampling status
 
-static volatile bool done; // Set to 'true' when LED scan cycle done
+static volatile uint32_t frame_count; // Incremented on each frame boundary
+
+// LED scan.
+// Frame consists of 8 columns by 'bitplanes' phases. Each slot started by TIM3 Update event, after that DMA does all the job:
+//   TIM3 Update -> DMA1 Ch3: Load period of next slot to TIM3 ARR
+//   TIM3 CC3    -> DMA1 Ch2: Load column mask to SPI1
+//   TIM3 CC1    -> DMA1 Ch6: Load row word to SPI2 (SPI2 RX interrupt latches it in STP16)
+// All 3 channels are circular. CPU touches scan only once per frame, when DMA1 Ch6 transfers last slot (see DMA1_Channel6_IRQHandler)
+//
+// Slots order: columns 1,2,...,7,0. Inside column: one phase per bitplane, from LSB to MSB, except 'sample_plane',
+// which goes last. Phase of bitplane P lasts 2^P time units (bit-angle modulation), so brightness of pixel is
+// proportional to its value. Last slot of frame lits column 0 with 'sample_plane' (used for LED voltage sampling).
+//
+// Each slot costs one SPI2 interrupt (row latch), so it is 8*bitplanes interrupts per frame (40 for 5 planes,
+// original 3 phases scan had 24). Handler is a few cycles, see 'Isr_RowLatch' statistics.
+static constexpr int scan_phases = bitplanes;
+static constexpr int scan_slots = 8*scan_phases;
+
+// Highest plane of color 2 (lit in color 3 too), so LED voltages are sampled on pixels of colors 2 and 3, as before
+// bit-angle modulation
+constexpr int top_plane(int br) {return br > 1 ? top_plane(br >> 1) + 1 : 0;}
+static constexpr int sample_plane = top_plane(color_br(2));
+
+// Plane shown in phase of column (ascending order, 'sample_plane' is moved to the end)
+constexpr int phase_plane(int phase)
+{
+    return phase == scan_phases-1 ? sample_plane : phase < sample_plane ? phase : phase + 1;
+}
+
+static constexpr int scan_clock_khz = 1125; // TIM3 clock (HCLK/128)
+static constexpr int scan_unit = scan_clock_khz*tick_time/(8*max_br); // Period of LSB phase (in TIM3 ticks)
+
+static_assert(scan_unit >= 8, "Too many bitplanes: LSB phase is shorter than row word transfer");
+
+// 10 ADC conversions of 252 ADC clocks (HCLK/8) should fit in sampling slot
+static constexpr int adc_sampling_ticks = 10*252*8/128;
+static_assert((scan_unit << sample_plane) >= adc_sampling_ticks, "LED voltage sampling slot is too short");
+
+constexpr uint16_t plane_period(int plane) {return (scan_unit << plane) - 1;} // On PB1 (at HCLK)
+
+struct ScanTables {
+    uint16_t periods[scan_slots]; // periods[i] is a period of slot i+1 (ARR loaded by Update event, which starts next slot)
+    uint16_t cols[scan_slots];
+
+    constexpr ScanTables() : periods{}, cols{}
+    {
+        for(int slot=0; slot < scan_slots; ++slot)
+        {
+            periods[slot] = plane_period(phase_plane((slot+1) % scan_phases));
+            cols[slot] = uint8_t(~(1 << ((slot/scan_phases + 1) & 7)));
+        }
+    }
+};
+
+static ScanTables scan_tables; // Not 'const' - DMA source kept in RAM
+
+// Frame in scan order: final row words exactly as DMA sends them to SPI2
+struct ScanFrame {
+    uint16_t rows[scan_slots];
+};
+
+// Displayed frames (triple buffering). 'present()' converts 'pixs' to 'spare_frame' and swaps it with 'ready_frame',
+// frame interrupt swaps 'ready_frame' with 'display_frame' and points DMA to it.
+// So interrupt never touches pixels and never sees half-drawn picture.
+// Exception is virtual screen (see 'vscreen.h'): its viewport is applied by frame interrupt, right in 'display_frame'
+static ScanFrame  frames[3];
+static ScanFrame* display_frame = &frames[0]; // Used by DMA
+static ScanFrame* ready_frame = &frames[1];   // Presented, but not displayed yet (if 'frame_ready')
+static ScanFrame* spare_frame = &frames[2];   // Owned by 'present()'
+static volatile bool frame_ready;
+
+// Interrupts statistics (see 'isr_stats.h'), in HCLK cycles.
+// Latency of scan interrupts is SysTick time of handler entry minus time of TIM3 tick of slot event. Both timers run
+// from HCLK and TIM3 prescaler is never restarted, so TIM3 ticks begin at fixed phase of SysTick ('tim3_phase',
+// measured at init within a few cycles).
+// Row latch interrupt runs 'scan_slots' times per frame, so it only keeps worst values of frame and frame interrupt
+// puts them to histograms (one value per frame).
+// Time of button edge is unknown, so EXTI latency is taken on software trigger of spare line 8, once per frame
+// (see 'wait_vsync').
+// Last entry is not interrupt: it is frame conversion by 'present()' (main loop, so it includes time of interrupts
+// preempting it). Together with frame interrupt duration it gives per frame scan cost on the board
+enum IsrStatsIdx {
+    Isr_Frame,      // DMA1_Channel6_IRQHandler. Slot DMA request at CNT==1, handler entered at TC
+    Isr_RowLatch,   // SPI2_IRQHandler. Row word is shifted out one TIM3 tick after DMA request (CNT==2). Worst of frame
+    Isr_Buttons,    // EXTI*_IRQHandler (preempts scan interrupts). Latency of software trigger from main loop
+    Isr_Present,    // 'pixs' to scan order conversion in 'present()'. Duration only
+    Isr_Total
+};
+static IsrStats isr_stats[Isr_Total] = {{"frame"}, {"row_latch"}, {"buttons"}, {"present"}};
+
+static constexpr uint32_t tim3_tick = 128; // HCLK cycles per TIM3 tick
+static uint32_t tim3_phase;                // SysTick value (modulo 'tim3_tick') at start of TIM3 tick
+
+static uint32_t row_latch_latency;  // Worst row latch latency of current frame
+static uint32_t row_latch_duration; // Worst row latch duration of current frame
+
+static volatile uint32_t exti_probe_time; // SysTick time of last software trigger of EXTI line 8
+
+const IsrStats* get_isr_stats(int idx) {return idx < Isr_Total ? &isr_stats[idx] : nullptr;}
+
+// Low word of SysTick counter (free running at HCLK)
+static inline uint32_t cycles() {return *(volatile uint32_t*)&SysTick->CNT;}
+
+// SysTick time and TIM3 counter of the same TIM3 tick (counter is read again if tick changed in between)
+static inline void slot_time(uint32_t& now, uint16_t& cnt)
+{
+    cnt = TIM3->CNT;
+    now = cycles();
+    uint16_t again = TIM3->CNT;
+    if (again != cnt)
+    {
+        cnt = again;
+        now = cycles();
+    }
+}
+
+// Cycles from start of TIM3 tick 'event_cnt' of current slot to 'now' ('cnt' - TIM3 counter at 'now')
+static inline uint32_t slot_latency(uint32_t now, uint16_t cnt, uint16_t event_cnt)
+{
+    return cnt >= event_cnt ? (cnt - event_cnt) * tim3_tick + (now - tim3_phase) % tim3_tick : 0;
+}
+
+// Entropy pool. Interrupts mix in cheap noisy values (entry time jitter, key bounces, ADC samples)
+static volatile uint32_t entropy_pool;
+
+static inline void entropy_mix(uint32_t value)
+{
+    uint32_t pool = entropy_pool;
+    entropy_pool = ((pool << 5) | (pool >> 27)) ^ value;
+}
 //////////////////////////////////////////////////////////////////////////////////////////
 
 static void dma_init()
@@ -50,25 +210,65 @@ static void dma_init()
     DMA_Init(DMA1_Channel1, &DMA_InitStructure);
 }
 
+// Setup one of scan DMA channels: circular, memory (scan_slots half-words) -> peripheral register
+static void scan_dma_init(DMA_Channel_TypeDef* channel, volatile void* dst, const uint16_t* src)
+{
+    DMA_InitTypeDef DMA_InitStructure = {0};
+    DMA_DeInit(channel);
+    DMA_InitStructure.DMA_PeripheralBaseAddr = (u32)dst;
+    DMA_InitStructure.DMA_MemoryBaseAddr = (u32)src;
+    DMA_InitStructure.DMA_DIR = DMA_DIR_PeripheralDST;
+    DMA_InitStructure.DMA_BufferSize = scan_slots;
+    DMA_InitStructure.DMA_PeripheralInc = DMA_PeripheralInc_Disable;
+    DMA_InitStructure.DMA_MemoryInc = DMA_MemoryInc_Enable;
+    DMA_InitStructure.DMA_PeripheralDataSize = DMA_PeripheralDataSize_HalfWord;
+    DMA_InitStructure.DMA_MemoryDataSize = DMA_MemoryDataSize_HalfWord;
+    DMA_InitStructure.DMA_Mode = DMA_Mode_Circular;
+    DMA_InitStructure.DMA_Priority = DMA_Priority_High;
+    DMA_InitStructure.DMA_M2M = DMA_M2M_Disable;
+    DMA_Init(channel, &DMA_InitStructure);
+    DMA_Cmd(channel, ENABLE);
+}
+
+// Convert 'src' to scan order
+static void build_scan_frame(const Pixels& src, ScanFrame& frame)
+{
+    uint16_t* dst = frame.rows;
+    for(int slot_col = 1; slot_col <= 8; ++slot_col)
+    {
+        int col = slot_col & 7;
+        for(int phase = 0; phase < scan_phases; ++phase)
+        {
+            int p = phase_plane(phase);
+            *dst++ = src.br[p][col] | (src.br[p][col+8]<<8);
+        }
+    }
+}
+
 extern "C" void SPI2_IRQHandler(void) __attribute__((interrupt("WCH-Interrupt-fast")));
 
+// Row word shifted out - pulse STP16 LE to latch it
 void SPI2_IRQHandler()
 {
+    uint32_t start;
+    uint16_t cnt;
+    slot_time(start, cnt);
     GPIO_SetBits(GPIOB, GPIO_Pin_12);
+    GPIO_ResetBits(GPIOB, GPIO_Pin_12);
 	(void)SPI2->DATAR;
+    uint32_t latency = slot_latency(start, cnt, 2);
+    if (latency > row_latch_latency) row_latch_latency = latency;
+    uint32_t duration = cycles() - start;
+    if (duration > row_latch_duration) row_latch_duration = duration;
 }
 
-static constexpr int period1 = 1125*tick_time/256-1; // On PB1 (at HCLK)
-static constexpr int period2 = 1125*3*tick_time/256-1;
-static constexpr int period3 = 1125*28*tick_time/256-1;
-
 
 void OurPlatformInit()
 {
     // ClockInit
     RCC_APB2PeriphClockCmd(RCC_APB2Periph_GPIOA|RCC_APB2Periph_GPIOB|RCC_APB2Periph_SPI1|RCC_APB2Periph_ADC1|RCC_APB2Periph_AFIO, ENABLE);
     RCC_APB1PeriphClockCmd(RCC_APB1Periph_TIM2|RCC_APB1Periph_TIM3|RCC_APB1Periph_SPI2, ENABLE);
-    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1|RCC_AHBPeriph_CRC, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
     RCC_ADCCLKConfig(RCC_PCLK2_Div8);
 
     // IO init
@@ -176,25 +376,35 @@ void OurPlatformInit()
 
     SPI_Cmd( SPI2, ENABLE );
 
-    // TIM3 init (sys clock) & Int
+    // TIM3 init (scan clock) & scan DMA
     NVIC_InitTypeDef NVIC_InitStructure={0};
     TIM_TimeBaseInitTypeDef TIM_TimeBaseInitStructure={0};
+    TIM_OCInitTypeDef TIM_OCInitStructure={0};
 
-    TIM_TimeBaseInitStructure.TIM_Period = period3; // On PB1 (at HCLK)
+    TIM_TimeBaseInitStructure.TIM_Period = scan_tables.periods[scan_slots-1]; // Period of slot 0 (On PB1 (at HCLK))
     TIM_TimeBaseInitStructure.TIM_Prescaler = 127;
     TIM_TimeBaseInitStructure.TIM_ClockDivision = TIM_CKD_DIV1;
     TIM_TimeBaseInitStructure.TIM_CounterMode = TIM_CounterMode_Up;
     TIM_TimeBaseInit( TIM3, &TIM_TimeBaseInitStructure);
 
-    TIM_ClearITPendingBit( TIM3, TIM_IT_Update );
+    // CC1/CC3 fired right after slot start (CNT==1), they only used as DMA requests
+    TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_Timing;
+    TIM_OCInitStructure.TIM_Pulse = 1;
+    TIM_OC1Init( TIM3, &TIM_OCInitStructure );
+    TIM_OC3Init( TIM3, &TIM_OCInitStructure );
 
-    NVIC_InitStructure.NVIC_IRQChannel =TIM3_IRQn;
+    scan_dma_init(DMA1_Channel3, &TIM3->ATRLR, scan_tables.periods);
+    scan_dma_init(DMA1_Channel2, &SPI1->DATAR, scan_tables.cols);
+    scan_dma_init(DMA1_Channel6, &SPI2->DATAR, display_frame->rows);
+    TIM_DMACmd(TIM3, TIM_DMA_Update|TIM_DMA_CC1|TIM_DMA_CC3, ENABLE);
+
+    NVIC_InitStructure.NVIC_IRQChannel = DMA1_Channel6_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority =1;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority =1;
     NVIC_InitStructure.NVIC_IRQChannelCmd =ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
-    TIM_ITConfig(TIM3, TIM_IT_Update, ENABLE);
+    DMA_ITConfig(DMA1_Channel6, DMA_IT_TC, ENABLE);
 
     NVIC_InitStructure.NVIC_IRQChannel = SPI2_IRQn;
     NVIC_InitStructure.NVIC_IRQChannelSubPriority =0;
@@ -212,7 +422,6 @@ void OurPlatformInit()
 	TIM_TimeBaseInitStructure.TIM_Prescaler = 0;
 	TIM_TimeBaseInit( TIM2, &TIM_TimeBaseInitStructure);
 
-    TIM_OCInitTypeDef TIM_OCInitStructure={0};
     TIM_OCInitStructure.TIM_OCMode = TIM_OCMode_PWM1;
 	TIM_OCInitStructure.TIM_OutputState = TIM_OutputState_Enable;
 	TIM_OCInitStructure.TIM_Pulse = 34734; // 1.75V on output
@@ -224,12 +433,9 @@ void OurPlatformInit()
 	TIM_ARRPreloadConfig( TIM2, ENABLE );
 	TIM_Cmd( TIM2, ENABLE );
 
-    // SysTick init (RND)
+    // SysTick init (cycle counter, entropy)
     SysTick->CTLR =5;
 
-    // CRC init
-    CRC_ResetDR();
-
     // EXTI0-EXTI7 init & EI
     for(uint8_t pin_source = 0; pin_source < 8; ++pin_source) GPIO_EXTILineConfig(GPIO_PortSourceGPIOA, pin_source);
 
@@ -251,9 +457,17 @@ void OurPlatformInit()
         NVIC_Init(&NVIC_InitStructure);
     }
 
-    // EI: TIM3
+    // EXTI8: software trigger only (no edges enabled), latency probe of EXTI9_5_IRQHandler
+    EXTI->INTENR |= EXTI_Line8;
+
+    // EI: TIM3 (start LED scan)
     TIM_Cmd( TIM3, ENABLE );
 
+    // Phase of TIM3 ticks in SysTick time (for latency of scan interrupts)
+    uint16_t cnt = TIM3->CNT;
+    while (TIM3->CNT == cnt) {;}
+    tim3_phase = cycles() % tim3_tick;
+
     // LED OE on
     GPIO_ResetBits(GPIOB, GPIO_Pin_11);
 }
@@ -276,7 +490,7 @@ std::pair<uint16_t, uint16_t> led_sence_get()
         for(int i=0; i<4; ++i)
         {
             uint16_t v = led_voltage[idx+i];
-            CRC->DATAR = v;
+            entropy_mix(v);
             int16_t val = v + adc_calibration;
             if (val < 0 || v == 0) val = 0; else
             if (val > 4095 || v == 4095) val = 4095;
@@ -327,11 +541,18 @@ PA15 - InInt indicator
 
 Timers:
 
-SysTick - CRC feed register (free running on max speed)
-TIM3 - System clock (for timer interrupt)
+SysTick - cycle counter, entropy source (free running on max speed)
+TIM3 - LED scan clock (drives scan DMA, no interrupt)
 TIM2 - PWM for LEDs LDO
 
-EXTI0-EXTI7 - Connected to PA0-7. Feed RND generator ob any button state change
+DMA1:
+
+Ch1 - ADC1 (LED voltage sampling)
+Ch2 - TIM3_CH3 -> SPI1 (columns)
+Ch3 - TIM3_UP  -> TIM3 ARR (slot period)
+Ch6 - TIM3_CH1 -> SPI2 (rows). TC interrupt - frame interrupt (DMA1_Channel6_IRQHandler)
+
+EXTI0-EXTI7 - Connected to PA0-7. Mix time of any button state change (bounces too) into entropy pool
 
 EXTI* int handlers:
 
@@ -350,128 +571,168 @@ EXTI9_5_IRQHandler
 
 //    ADC_RegularChannelConfig(ADC1, get_active_adc() ? 8 : 9, 1, ADC_SampleTime_1Cycles5);
 
-void seed_rnd_value()
+// Entropy pool, finalized by murmur3 mixer (only for seeding, random values are generated by common code)
+uint32_t get_entropy()
 {
-    CRC->DATAR = SysTick->CNT;
+    uint32_t h = entropy_pool ^ cycles();
+    h = (h ^ (h >> 16)) * 0x85EBCA6B;
+    h = (h ^ (h >> 13)) * 0xC2B2AE35;
+    return h ^ (h >> 16);
 }
 
-uint32_t get_random()
+// Message goes to debug USART, LEDs show full brightness checkerboard (no game draws it). Interrupts keep running,
+// so scan (and the picture) stays alive while CPU spins here
+void fatal_error(const char* what)
 {
-    seed_rnd_value();
-    return CRC->DATAR;
+    printf("FATAL: %s\r\n", what);
+    vscreen_hide();
+    for(int y = 0; y < 16; ++y) pixs.set_row(y, y & 1 ? 0xAA : 0x55, y & 1 ? 0xAA : 0x55);
+    for(;;)
+    {
+        present();
+        wait_vsync();
+    }
 }
 
-extern "C" void TIM3_IRQHandler() __attribute__((interrupt("WCH-Interrupt-fast")));
+// Game traces are dumped to debug USART only when built with TRACE_DUMP=1 (see 'trace.h'): output is blocking and
+// takes about 0.7 s for 4 KB trace at 115200 baud, so game over screen would wait for it after every game.
+// Same for timeline (TIMELINE_DUMP=1, see 'timeline.h'): 256 records are about 4 KB of text
 
-void TIM3_IRQHandler()
+// Dump trace to debug USART as hex lines (and timeline after it). Use 'scripts/trace2bin.py' to extract it from terminal log
+void trace_save(const uint8_t* data, uint32_t size)
 {
-    GPIO_SetBits(GPIOA, GPIO_Pin_15); // Set 'InInt' indicator
+#if TRACE_DUMP
+    printf("TRACE %lu\r\n", (unsigned long)size);
+    for(uint32_t i = 0; i < size; ++i)
+    {
+        printf("%02X", data[i]);
+        if (i % 32 == 31 || i == size-1) printf("\r\n");
+    }
+    printf("END\r\n");
+#else
+    (void)data;
+    (void)size;
+#endif
+#if TIMELINE_DUMP
+    timeline_print(); // Last trace points of game (use 'scripts/timeline2json.py')
+#endif
+}
 
-    // Pixels
-    uint16_t row=0;
-    uint8_t col = ~(1<<col_index);
-    uint16_t nxt_period = period3;
+extern "C" void DMA1_Channel6_IRQHandler() __attribute__((interrupt("WCH-Interrupt-fast")));
 
-    uint16_t row2 = working_pixels.br2[col_index] | (working_pixels.br2[col_index+8]<<8);
-    uint16_t row1 = working_pixels.br1[col_index] | (working_pixels.br1[col_index+8]<<8);
+// Frame interrupt. Fired when row word of last slot (column 0, 'sample_plane') taken by DMA,
+// so DMA does not read 'display_frame' until next slot begins: it may be switched to 'ready_frame' (or rewritten)
+void DMA1_Channel6_IRQHandler()
+{
+    uint32_t start;
+    uint16_t cnt;
+    slot_time(start, cnt);
+    TRACE_BEGIN(TP_FrameIsr);
+    GPIO_SetBits(GPIOA, GPIO_Pin_15); // Set 'InInt' indicator
 
-    switch(phase)
-    {
-        case 0: // Br - 3
-            nxt_period = period3;
-            row = row1&row2;
-            break;
-        case 1: // Br - 1
-            nxt_period = period1;
-            row = row1|row2;
-            break;
-        case 2: // Br - 2
-            nxt_period = period2;
-            row = row2;
-            break;
-        default: ;
-    }
-    TIM_SetAutoreload(TIM3, nxt_period);
-    GPIO_ResetBits(GPIOB, GPIO_Pin_12);
-    SPI1->DATAR = col;
-    SPI2->DATAR = row;
-/*
-    if (phase!=2)
+    // Keys
+    uint16_t sample = GPIOA->INDR;
+    entropy_mix(start ^ (sample << 16));
+    if (uint8_t changed_keys = debounce_keys(~sample))
     {
-        uint8_t* array = phase ? working_pixels.br2 : working_pixels.br1;
-        row = array[col_index] | (array[col_index+8]<<8);
-        GPIO_ResetBits(GPIOB, GPIO_Pin_12);
-        SPI1->DATAR = col;
-        SPI2->DATAR = row;
+        for(uint8_t key = 1; key; key <<= 1)
+        {
+            if (changed_keys & key) key_queue.put({uint16_t(frame_count), key, (cur_keys & key) != 0});
+        }
     }
-*/
-    if (!debounce)
+
+    // ADC. Sampling performed during last slot of frame (column 0 lit by 'sample_plane': pixels of colors 2 and 3)
+    if (request_led_voltages == LEDVoltageReq::InProgress)
     {
-        uint8_t buttons = ~GPIOA->INDR;
-        changed_keys |= cur_keys ^ buttons;
+        request_led_voltages = LEDVoltageReq::Ready;
+        ADC_SoftwareStartConvCmd(ADC1, DISABLE);
     }
-    // ADC
-    if (phase == 0 && request_led_voltages == LEDVoltageReq::Request && ((working_pixels.br2[0]&1) || (working_pixels.br2[8]&1)))
+    uint16_t row = display_frame->rows[scan_slots-1];
+    if (request_led_voltages == LEDVoltageReq::Request && (row & 0x0101))
     {
         request_led_voltages = LEDVoltageReq::InProgress;
         leds_to_sample = 0;
-        if (working_pixels.br2[0]&1) leds_to_sample |= 1;
-        if (working_pixels.br2[8]&1) leds_to_sample |= 2;
+        if (row & 0x0001) leds_to_sample |= 1;
+        if (row & 0x0100) leds_to_sample |= 2;
         ADC_SoftwareStartConvCmd(ADC1, ENABLE);
     }
-    if (phase == 1 && request_led_voltages == LEDVoltageReq::InProgress)
+
+    // Virtual screen: viewport window is converted right into displayed frame (DMA does not read it until next slot)
+    if (vscreen_shown())
     {
-        request_led_voltages = LEDVoltageReq::Ready;
-        ADC_SoftwareStartConvCmd(ADC1, DISABLE);
+        static Pixels window;
+        if (vscreen_frame(window)) build_scan_frame(window, *display_frame);
     }
-    ++phase;
-    if (phase == 3)
+    // Switch DMA to presented frame. Channel is idle until next slot begins, so it is safe to reprogram it
+    else if (frame_ready)
     {
-        phase = 0;
-        ++col_index;
-        if (col_index == 8)
-        {
-            col_index = 0;
-            done = true;
-            working_pixels = pixs;
-            if (debounce) --debounce; else
-            if (changed_keys)
-            {
-                cur_keys ^= changed_keys;
-                active_keys = (active_keys & ~changed_keys) | (cur_keys & changed_keys);
-                debounce = debounce_time;
-                changed_keys = 0;
-            }
-        }
+        std::swap(display_frame, ready_frame);
+        frame_ready = false;
+        DMA_Cmd(DMA1_Channel6, DISABLE);
+        DMA1_Channel6->MADDR = (u32)display_frame->rows;
+        DMA_SetCurrDataCounter(DMA1_Channel6, scan_slots);
+        DMA_Cmd(DMA1_Channel6, ENABLE);
     }
-    TIM_ClearITPendingBit( TIM3, TIM_IT_Update );
+    ++frame_count;
+
+    DMA_ClearITPendingBit(DMA1_IT_TC6);
     GPIO_ResetBits(GPIOA, GPIO_Pin_15); // Reset 'InInt' indicator
+    TRACE_END(TP_FrameIsr);
+
+    isr_stats[Isr_Frame].latency.add(slot_latency(start, cnt, 1));
+    isr_stats[Isr_Frame].duration.add(cycles() - start);
+
+    // Row latch statistics of finished frame (row latch interrupt has the same priority, so it can't come in between)
+    isr_stats[Isr_RowLatch].latency.add(row_latch_latency);
+    isr_stats[Isr_RowLatch].duration.add(row_latch_duration);
+    row_latch_latency = row_latch_duration = 0;
+}
+
+void present()
+{
+    if (vscreen_shown()) return; // Frame interrupt shows viewport of 'vscreen'
+    uint32_t start = cycles();
+    build_scan_frame(pixs, *spare_frame);
+    __disable_irq();
+    std::swap(spare_frame, ready_frame);
+    frame_ready = true;
+    __enable_irq();
+    isr_stats[Isr_Present].duration.add(cycles() - start);
 }
 
-uint8_t read_key()
+uint32_t wait_vsync()
 {
-    while(!done)
+    static uint32_t last_frame;
+    // EXTI latency probe (see 'Isr_Buttons')
+    exti_probe_time = cycles();
+    EXTI->SWIEVR = EXTI_Line8;
+    while(last_frame == frame_count)
     {
         __WFI();
     }
-    done = false;
-    return active_keys;
+    uint32_t frame = frame_count;
+    uint32_t result = frame - last_frame;
+    last_frame = frame;
+    return result;
 }
 
-void clr_keys(uint8_t keys)
-{
-    __disable_irq();
-    active_keys &= ~keys;
-    __enable_irq();
-}
+uint32_t get_cycles() {return cycles();}
+const uint32_t cycles_per_us = 144; // HCLK
 
 #define H(nm, ln) \
 extern "C" void nm() __attribute__((interrupt("WCH-Interrupt-fast"))); \
-void nm() {seed_rnd_value(); EXTI_ClearITPendingBit(ln);}
+void nm() \
+{ \
+    uint32_t start = cycles(); \
+    if (((ln) & EXTI_Line8) && (EXTI->INTFR & EXTI_Line8)) isr_stats[Isr_Buttons].latency.add(start - exti_probe_time); \
+    entropy_mix(start); \
+    EXTI_ClearITPendingBit(ln); \
+    isr_stats[Isr_Buttons].duration.add(cycles() - start); \
+}
 
 H(EXTI0_IRQHandler, EXTI_Line0)
 H(EXTI1_IRQHandler, EXTI_Line1)
 H(EXTI2_IRQHandler, EXTI_Line2)
 H(EXTI3_IRQHandler, EXTI_Line3)
 H(EXTI4_IRQHandler, EXTI_Line4)
-H(EXTI9_5_IRQHandler, EXTI_Line5|EXTI_Line6|EXTI_Line7)
+H(EXTI9_5_IRQHandler, EXTI_Line5|EXTI_Line6|EXTI_Line7|EXTI_Line8)
@@ -1,13 +1,72 @@
 #pragma once
 
-union Arena {
-    struct {
-        uint16_t body[512]; // 8*16 pixels of snake body
-    } snake;
-    struct {
-        uint8_t bullets[16];
-        uint8_t spsheeps[16];
-    } invation;
+#include "interface.h"
+#include <new>
+#include <type_traits>
+
+// RAM budget (in bytes) of per-game scratch memory
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 1024
+#endif
+
+static_assert(ARENA_SIZE % 4 == 0, "Arena size should be word aligned");
+
+// Per-game bump allocator. All memory is released at once on game exit (see 'ArenaScope').
+// Allocated memory is zero filled; objects are not constructed, so only trivial types are allowed.
+class Arena {
+    alignas(8) uint8_t memory[ARENA_SIZE];
+    uint32_t used = 0;
+
+    friend class ArenaScope;
+
+public:
+    static constexpr uint32_t size = ARENA_SIZE;
+
+    // Allocate 'n' items of T sized at runtime (for example, by game level). No room is fatal error on every build
+    template<typename T>
+    T* alloc(uint32_t n)
+    {
+        static_assert(std::is_trivial<T>::value, "Arena holds only trivial types");
+        static_assert(alignof(T) <= 8, "Arena alignment is 8");
+        uint32_t start = (used + alignof(T) - 1) & ~uint32_t(alignof(T) - 1);
+        if (n > (size - start) / sizeof(T)) fatal_error("Arena overflow");
+        used = start + n * sizeof(T);
+        memset(memory + start, 0, n * sizeof(T));
+        return reinterpret_cast<T*>(memory + start);
+    }
+
+    // Allocate fixed number of items, checked against arena budget at compile time
+    template<typename T, uint32_t N = 1>
+    T* alloc()
+    {
+        static_assert(sizeof(T) * N <= size, "Arena budget exceeded (see ARENA_SIZE)");
+        return alloc<T>(N);
+    }
+
+    // Construct object of T (arena never calls destructors). Checked against arena budget at compile time
+    template<typename T, typename... Args>
+    T* create(Args&&... args)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena never calls destructors");
+        static_assert(sizeof(T) <= size, "Arena budget exceeded (see ARENA_SIZE)");
+        static_assert(alignof(T) <= 8, "Arena alignment is 8");
+        uint32_t start = (used + alignof(T) - 1) & ~uint32_t(alignof(T) - 1);
+        if (sizeof(T) > size - start) fatal_error("Arena overflow");
+        used = start + sizeof(T);
+        return new (memory + start) T(static_cast<Args&&>(args)...);
+    }
+
+    uint32_t available() const {return size - used;}
 };
 
-extern Arena arena;
+extern INSTANCE_LOCAL Arena arena;
+
+// Release all arena allocations done during its lifetime
+class ArenaScope {
+    uint32_t mark;
+public:
+    ArenaScope() : mark(arena.used) {}
+    ~ArenaScope() {arena.used = mark;}
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "interface.h"
+
+// Input of one game step
+struct FrameInput {
+    static constexpr int max_events = 8;
+
+    uint8_t keys;           // Keys state, as returned by 'read_key'
+    uint8_t total_events;
+    KeyEvent events[max_events]; // Key events consumed in this frame, oldest first (extra events update 'keys' only)
+
+    // Next pressed key after event 'idx' (0 if none). Usage: for(int i=0; int key = input.next_press(i);) ...
+    uint8_t next_press(int& idx) const
+    {
+        while (idx < total_events)
+        {
+            const KeyEvent& event = events[idx++];
+            if (event.press) return event.key;
+        }
+        return 0;
+    }
+};
+
+/*
+    Game. Created in 'arena' at game start (constructor draws initial picture), then platform loop (see 'run_game')
+    calls 'update' once per frame (tick_time ms) and 'render' before every 'present'.
+    Object is never destroyed - it should not own anything but arena memory.
+*/
+class Game {
+public:
+    virtual bool update(const FrameInput& input) = 0; // Advance one frame. Return false at game over
+    virtual void render(Pixels& dst) = 0;             // Draw current picture
+    virtual uint32_t score() const = 0;               // Player result so far (returned by 'run_game')
+};
+
+class Autoplayer;
+
+struct GameInfo {
+    const char* name;
+    uint8_t logo;           // Logo animation (order of '%logo' in 'sprites.txt')
+    Game* (*create)();      // Create game in 'arena'
+    Autoplayer* (*create_bot)(); // Create autoplayer in 'arena' (attract mode, host bots). nullptr - game has no bot
+};
+
+// Registry of games (in menu order). Index in it is a game id ('run_game', traces)
+extern const GameInfo games[];
+extern const int total_games;
+
+// Frame time statistics (updates + render of one displayed frame), in 'get_cycles' units
+struct FrameStats {
+    uint32_t frames;    // Rendered frames
+    uint32_t missed;    // Extra updates (game loop was late for frame boundary and catched up)
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+
+    void add(uint32_t cycles)
+    {
+        if (!frames || cycles < min) min = cycles;
+        if (cycles > max) max = cycles;
+        total += cycles;
+        ++frames;
+    }
+    uint32_t avg() const {return frames ? uint32_t(total / frames) : 0;}
+};
+
+extern INSTANCE_LOCAL FrameStats game_stats[]; // Per game, accumulated since power on
+
+/*
+    Autoplayer. Plays instead of player (see 'run_game'): looks at picture of previous frame and tells which keys
+    are held in this frame. Key events for game are made from changes of returned state.
+    Created in 'arena' before game, never destroyed.
+*/
+class Autoplayer {
+public:
+    FrameStats search;  // Time of 'keys' calls which planned moves, in 'get_cycles' units ('missed' is not used)
+
+    virtual uint8_t keys(const Pixels& screen) = 0;
+};
+
+// Start new frame (call after 'wait_vsync'): consume key events and run background tasks (see 'scheduler.h')
+void read_frame_input(FrameInput& input);
@@ -1,25 +1,155 @@
 ﻿#include "interface.h"
 #include "arena.h"
+#include "key_queue.h"
+#include "trace.h"
+#include "scheduler.h"
+#include "game.h"
 
-Pixels pixs;
-Arena arena;
+INSTANCE_LOCAL Pixels pixs;
+INSTANCE_LOCAL Arena arena;
+INSTANCE_LOCAL KeyQueue key_queue;
 
-int Pixels::get_br(int x, int y)
+static INSTANCE_LOCAL uint8_t active_keys; // Pressed keys, but with posibility to top level code shut down separate bits from 1 to 0 (depress them)
+static INSTANCE_LOCAL uint32_t rnd_state[4] = {1};
+static INSTANCE_LOCAL uint8_t rnd_reseed_countdown = random_reseed_period;
+
+bool poll_key_event(KeyEvent& event)
+{
+    if (!key_queue.get(event)) return false;
+    if (event.press) active_keys |= event.key; else active_keys &= ~event.key;
+    trace_key(event);
+    task_key_event(event);
+    return true;
+}
+
+uint8_t read_key()
+{
+    KeyEvent event;
+    while (poll_key_event(event)) {;}
+    return active_keys;
+}
+
+void clr_keys(uint8_t keys)
+{
+    active_keys &= ~keys;
+}
+
+void restore_keys(uint8_t active)
 {
-    return ((br1[y] >> x) & 1) + ((br2[y] >> x) & 1)*2;
+    KeyEvent event;
+    while (key_queue.get(event)) {;}
+    active_keys = active;
 }
 
-void Pixels::set_br(int x, int y, int br)
+void read_frame_input(FrameInput& input)
 {
-    uint8_t& b1 = br1[y];
-    uint8_t& b2 = br2[y];
-    uint8_t mask = 1 << x;
-    switch (br&3)
+    trace_next_frame();
+    if (!--rnd_reseed_countdown)
+    {
+        rnd_reseed_countdown = random_reseed_period;
+        if (!trace_active()) seed_random(get_random() ^ get_entropy());
+    }
+    input.total_events = 0;
+    KeyEvent event;
+    while (poll_key_event(event))
     {
-        case 0: b1 &= ~mask; b2 &= ~mask; break;
-        case 1: b1 |=  mask; b2 &= ~mask; break;
-        case 2: b1 &= ~mask; b2 |=  mask; break;
-        case 3: b1 |=  mask; b2 |=  mask; break;
+        if (input.total_events < FrameInput::max_events) input.events[input.total_events++] = event;
     }
+    input.keys = active_keys;
+    run_tasks();
 }
 
+uint8_t next_frame()
+{
+    present();
+    wait_vsync();
+    FrameInput input;
+    read_frame_input(input);
+    return input.keys;
+}
+
+static inline uint32_t rotl(uint32_t v, int k) {return (v << k) | (v >> (32 - k));}
+
+// Expand seed to xoshiro state by splitmix32 (never gives all-zero state)
+void seed_random(uint32_t seed)
+{
+    rnd_reseed_countdown = random_reseed_period;
+    for(auto& s: rnd_state)
+    {
+        uint32_t z = (seed += 0x9E3779B9);
+        z = (z ^ (z >> 16)) * 0x85EBCA6B;
+        z = (z ^ (z >> 13)) * 0xC2B2AE35;
+        s = z ^ (z >> 16);
+    }
+}
+
+// xoshiro128**
+uint32_t get_random()
+{
+    uint32_t result = rotl(rnd_state[1] * 5, 7) * 9;
+    uint32_t t = rnd_state[1] << 9;
+    rnd_state[2] ^= rnd_state[0];
+    rnd_state[3] ^= rnd_state[1];
+    rnd_state[1] ^= rnd_state[2];
+    rnd_state[0] ^= rnd_state[3];
+    rnd_state[2] ^= t;
+    rnd_state[3] = rotl(rnd_state[3], 11);
+    return result;
+}
+
+// Multiply-shift with rejection of biased low part (Lemire). Division only on rare rejection path
+uint32_t random_below(uint32_t n)
+{
+    uint64_t m = uint64_t(get_random()) * n;
+    if (uint32_t(m) < n)
+    {
+        uint32_t threshold = -n % n;
+        while (uint32_t(m) < threshold) m = uint64_t(get_random()) * n;
+    }
+    return m >> 32;
+}
+
+static int popcount(uint32_t v)
+{
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    return (((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24;
+}
+
+int Bitboard::count() const
+{
+    return popcount(w[0]) + popcount(w[1]) + popcount(w[2]) + popcount(w[3]);
+}
+
+// Skip whole words, then whole rows, then scan bits of one row
+int Bitboard::select(int n) const
+{
+    for (int k = 0; k < 4; ++k)
+    {
+        uint32_t v = w[k];
+        int cnt = popcount(v);
+        if (n >= cnt) {n -= cnt; continue;}
+        for (int y = k*4; ; ++y, v >>= 8)
+        {
+            cnt = popcount(v & 0xFF);
+            if (n >= cnt) {n -= cnt; continue;}
+            for (int x = 0; ; ++x)
+            {
+                if (((v >> x) & 1) && !n--) return x + y*8;
+            }
+        }
+    }
+    return -1;
+}
+
+int Pixels::get_br(int x, int y) const
+{
+    int result = 0;
+    for (int p = bitplanes; p--;) result = (result << 1) | ((br[p][y] >> x) & 1);
+    return result;
+}
+
+void Pixels::set_br(int x, int y, int value)
+{
+    set_mask(y, 1 << x, value);
+}
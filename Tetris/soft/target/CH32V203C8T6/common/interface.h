@@ -9,20 +9,135 @@
 #define assert(...)
 #endif
 
+// Storage of per-instance state of common code (picture, game memory, input, random, tasks, trace).
+// Device and emulator run single instance; host tournament runs independent instance in every thread
+#ifdef INSTANCE_PER_THREAD
+#define INSTANCE_LOCAL thread_local
+#else
+#define INSTANCE_LOCAL
+#endif
+
 
 static constexpr int tick_time = 15;  // In ms
 
+// Number of brightness bitplanes (bit-angle modulation): 2^PIXEL_BITPLANES brightness levels.
+// 5 planes reproduce original 1:4:32 brightness curve of 3 base colors, 2 planes give linear 1:2:3
+#ifndef PIXEL_BITPLANES
+#define PIXEL_BITPLANES 5
+#endif
+
+static constexpr int bitplanes = PIXEL_BITPLANES;
+static constexpr int max_br = (1 << bitplanes) - 1;
+
+static_assert(bitplanes >= 2 && bitplanes <= 8, "Unsupported number of bitplanes");
+
+// Brightness of base color (0 - Off, 1 - Dim, 2 - Medium, 3 - Full).
+// Follows 1:4:32 curve as close as depth allows, keeping all levels distinct
+constexpr int color_br(int color)
+{
+    constexpr int weights[4] = {0, 1, 4, 32};
+    int result = (max_br * weights[color&3] + 16) / 32;
+    return result < (color&3) ? (color&3) : result;
+}
+
+// Base color of brightness (highest color not brighter than 'br')
+constexpr int br_color(int br)
+{
+    int result = 3;
+    while (result && color_br(result) > br) --result;
+    return result;
+}
+
+// 8x16 bitmap in 4 words. Row Y is byte Y%4 of word Y/4 (little endian), bit X of row - pixel (X,Y).
+// Sprite rows (see 'SpriteDef') are packed the same way, so sprite is put on board by one shift
+struct Bitboard {
+    uint32_t w[4];
+
+    bool get(int x, int y) const {return (w[y/4] >> (y%4*8 + x)) & 1;}
+    uint8_t row(int y) const {return w[y/4] >> (y%4*8);}
+    void set(int x, int y) {w[y/4] |= 1u << (y%4*8 + x);}
+    void reset(int x, int y) {w[y/4] &= ~(1u << (y%4*8 + x));}
+
+    int count() const;       // Number of set pixels
+    int select(int n) const; // Position (x + y*8) of n-th set pixel (n < count()). Bounded time
+};
 
 struct Pixels {
-    uint8_t br1[16];
-    uint8_t br2[16];
+    union {
+        uint8_t br[bitplanes][16]; // Bitplanes. br[0] - LSB of brightness, br[bitplanes-1] - MSB. Bit X of br[p][Y] - pixel (X,Y)
+        Bitboard planes[bitplanes];// Same bitplanes, word access
+    };
 
-    int get_br(int x, int y);
+    int get_br(int x, int y) const;
     void set_br(int x, int y, int br);
+    int get_color(int x, int y) const {return br_color(get_br(x, y));}
+    void set_color(int x, int y, int color) {set_br(x, y, color_br(color));}
+
+    // Put row in 2-plane format (base color of pixel is bit from 'c1' + bit from 'c2' * 2), as used by sprites & logos
+    void set_row(int y, uint8_t c1, uint8_t c2)
+    {
+        for(int p = 0; p < bitplanes; ++p) br[p][y] = plane_bits(p, c1, c2);
+    }
+    // Set brightness of all pixels in 'mask' of row 'y'
+    void set_mask(int y, uint8_t mask, int value)
+    {
+        for(int p = 0; p < bitplanes; ++p, value >>= 1)
+        {
+            if (value & 1) br[p][y] |= mask; else br[p][y] &= ~mask;
+        }
+    }
+    // Mask of lit pixels in row
+    uint8_t row_mask(int y) const
+    {
+        uint8_t result = 0;
+        for(int p = 0; p < bitplanes; ++p) result |= br[p][y];
+        return result;
+    }
+    void copy_row(int dst, int src)
+    {
+        for(int p = 0; p < bitplanes; ++p) br[p][dst] = br[p][src];
+    }
+    // Mask of lit pixels in word 'w' of bitboard (4 rows)
+    uint32_t word_mask(int w) const
+    {
+        uint32_t result = 0;
+        for(int p = 0; p < bitplanes; ++p) result |= planes[p].w[w];
+        return result;
+    }
+    // Lit pixels
+    Bitboard occupancy() const
+    {
+        Bitboard result;
+        for(int w = 0; w < 4; ++w) result.w[w] = word_mask(w);
+        return result;
+    }
+    // Pixels of brightness 'value'
+    Bitboard br_mask(int value) const
+    {
+        Bitboard result;
+        for(int w = 0; w < 4; ++w)
+        {
+            result.w[w] = ~0u;
+            for(int p = 0; p < bitplanes; ++p) result.w[w] &= (value >> p) & 1 ? planes[p].w[w] : ~planes[p].w[w];
+        }
+        return result;
+    }
     void clear() {memset(this, 0, sizeof(*this));}
+
+    // Bits of bitplane 'p' for row (or bitboard word) in 2-plane format (see 'set_row')
+    template<typename T>
+    static T plane_bits(int p, T c1, T c2)
+    {
+        T result = 0;
+        if ((color_br(1) >> p) & 1) result |= c1 & ~c2;
+        if ((color_br(2) >> p) & 1) result |= c2 & ~c1;
+        if ((color_br(3) >> p) & 1) result |= c1 & c2;
+        return result;
+    }
 };
 
-extern Pixels pixs;
+// Back buffer. Games draw here, then call 'present()' to show it. Content is preserved after 'present()'
+extern INSTANCE_LOCAL Pixels pixs;
 
 enum Key {
     K_Up    = 1<<3,
@@ -35,13 +150,46 @@ enum Key {
     K_3     = 1<<4
 };
 
+// Key state change
+struct KeyEvent {
+    uint16_t frame; // Number of frame (low bits) when change was detected
+    uint8_t key;    // One of 'Key'
+    bool press;     // true - key pressed, false - released
+};
+
 ////////////////////////////
-// Functions implemeted by platform
-uint8_t read_key();
-void clr_keys(uint8_t keys);
+// Keys. Implemented in common part on top of key events queue (filled by platform, see 'key_queue.h')
+uint8_t read_key();                   // Return current keys state (no wait). All pending key events consumed
+void clr_keys(uint8_t keys);          // Mark keys as released (until next press)
+bool poll_key_event(KeyEvent& event); // Fetch next key event (no wait). Returns false if no events. 'read_key' state updated too
+
+////////////////////////////
+// Random. Deterministic generator (seeded at game start, see 'trace.h'). Reseeded from platform entropy
+// every 'random_reseed_period' frames when no trace recorded or replayed
+static constexpr int random_reseed_period = 64;
+
 uint32_t get_random();
+uint32_t random_below(uint32_t n); // Uniform (bias free) value in range [0, n)
+void seed_random(uint32_t seed);   // Also restarts reseed period
+
+////////////////////////////
+// Functions implemeted by platform
+uint32_t get_entropy();      // Non deterministic random value (for seeding)
+void present();              // Show 'pixs' starting from next frame (displayed image switched at frame boundary only, no tearing)
+uint32_t wait_vsync();       // Wait for frame boundary. Returns frames passed since previous call (at least 1)
+uint32_t get_cycles();       // Free running time counter (for profiling), 'cycles_per_us' per microsecond
+extern const uint32_t cycles_per_us;
+[[noreturn]] void fatal_error(const char* what); // Unrecoverable error (e.g. arena overflow): report it and stop
+
+// One step of simple blocking loop (menu; games are run by 'run_game' loop): show drawn picture, wait for next frame,
+// run background tasks (see 'scheduler.h') and return keys
+uint8_t next_frame();
 
 ///////////////////////////
 // Main entry. Implemeted in common part
 extern "C" void entry();
+class Autoplayer;
+// Run game (index in 'games' registry, see 'game.h') until it ends. Returns its score.
+// With 'bot' game is played by autoplayer until its end or until player presses any key
+uint32_t run_game(int game, Autoplayer* bot = nullptr);
 extern "C" void OurPlatformInit();
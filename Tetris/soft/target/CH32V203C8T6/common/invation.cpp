@@ -2,6 +2,7 @@
 #include "spr_defs.h"
 #include "timer.h"
 #include "arena.h"
+#include "game.h"
 
 struct ShIdx {
     uint16_t start;
@@ -44,9 +45,10 @@ const LevelSetup levels[TotalLevels] = {
     {3, 3}
 };
 
-class Invation {
+class Invation : public Game {
+    Pixels field;
     Timer t, t2;
-    Sprite spr = Sprite_platform;
+    Sprite spr = {Sprite_platform, field};
     union {
         struct {
             uint8_t phase;
@@ -61,6 +63,13 @@ class Invation {
     };
 
     uint8_t platform_pos = 4;
+    uint8_t perv_btn = 0;
+    bool final = false; // Final animation is running
+    uint32_t total_eaten = 0; // Score (spaceships shot down on all levels)
+
+    // Field rows (bit per column): bullets and spaceships
+    uint8_t* bullets = arena.alloc<uint8_t, 16>();
+    uint8_t* spsheeps = arena.alloc<uint8_t, 16>();
 
     void show();
     void move_bullets();
@@ -78,9 +87,10 @@ class Invation {
         Blast
     };
     GameStatus tick();
-    GameStatus run_internal();
+    GameStatus update_game(uint8_t keys);
 
-    void final_animate(GameStatus);
+    bool start_final(GameStatus);
+    bool update_final(uint8_t keys);
 
     void animate_platform();
     void animate_sps();
@@ -94,8 +104,23 @@ public:
         level = 0;
         sps_eaten = 0;
         last_row_count = 0;
+        field.clear();
+        spsheeps[0] = bits[random_below(bits_idx[0])] << 1;
+    }
+
+    bool update(const FrameInput& input) override
+    {
+        if (final) return update_final(input.keys);
+        auto result = update_game(input.keys);
+        return result == Cont || start_final(result);
+    }
+
+    uint32_t score() const override {return total_eaten;}
+
+    void render(Pixels& dst) override
+    {
+        dst = field;
     }
-    void run();
 };
 
 
@@ -103,23 +128,22 @@ void Invation::show()
 {
     for ( int i = 0; i < 16; ++i )
     {
-        pixs.br1[i] = arena.invation.bullets[i] | arena.invation.spsheeps[i];
-        pixs.br2[i] = arena.invation.bullets[i];
+        field.set_row(i, bullets[i] | spsheeps[i], bullets[i]);
     }
     spr.place(platform_pos, 15, phase);
 }
 
 void Invation::move_bullets()
 {
-    memmove(arena.invation.bullets, arena.invation.bullets+1, 15);
-    arena.invation.bullets[13] = 0;
+    memmove(bullets, bullets+1, 15);
+    bullets[13] = 0;
     chk_bullets();
 }
 
 bool Invation::move_sps()
 {
-    memmove(arena.invation.spsheeps+1, arena.invation.spsheeps, 15);
-    arena.invation.spsheeps[0] = 0;
+    memmove(spsheeps+1, spsheeps, 15);
+    spsheeps[0] = 0;
     chk_bullets();
     last_row_count++;
     return chk_platform();
@@ -129,14 +153,15 @@ void Invation::chk_bullets()
 {
     for ( int i = 0; i < 16; ++i )
     {
-        auto & a1 = arena.invation.bullets[i];
-        auto & a2 = arena.invation.spsheeps[i];
+        auto & a1 = bullets[i];
+        auto & a2 = spsheeps[i];
         auto mask = a1 & a2;
         if ( mask )
         {
             a1 &= ~mask;
             a2 &= ~mask;
             ++sps_eaten;
+            ++total_eaten;
         }
     }
 }
@@ -144,16 +169,16 @@ void Invation::chk_bullets()
 bool Invation::chk_platform()
 {
     int mask = 1<<platform_pos;
-    arena.invation.spsheeps[14] &= ~mask;
+    spsheeps[14] &= ~mask;
     mask = 7 << (platform_pos-1);
-    return (arena.invation.spsheeps[15] & mask) != 0;
+    return (spsheeps[15] & mask) != 0;
 }
 
 void Invation::fire()
 {
     int mask = 1 << platform_pos;
-    if (arena.invation.spsheeps[13] & mask ) {arena.invation.spsheeps[13] &= ~mask; ++sps_eaten;}
-    else arena.invation.bullets[13] |= mask;
+    if (spsheeps[13] & mask ) {spsheeps[13] &= ~mask; ++sps_eaten; ++total_eaten;}
+    else bullets[13] |= mask;
 }
 
 void Invation::move_platform(int delta)
@@ -161,18 +186,20 @@ void Invation::move_platform(int delta)
     int new_pp = platform_pos+delta;
     if (new_pp < 1 || new_pp > 6) return;
     int nxt_mask = 1 << new_pp;
-    if (nxt_mask & arena.invation.spsheeps[14]) 
+    if (nxt_mask & spsheeps[14]) 
     {
-        arena.invation.spsheeps[14] &= ~nxt_mask;
-        pixs.br1[14] &= ~nxt_mask;
+        spsheeps[14] &= ~nxt_mask;
+        field.set_mask(14, nxt_mask, 0);
         ++sps_eaten;
+        ++total_eaten;
     }
     if (delta == 1) nxt_mask <<= 1; else nxt_mask >>= 1;
-    if (nxt_mask & arena.invation.spsheeps[15]) 
+    if (nxt_mask & spsheeps[15]) 
     {
-        arena.invation.spsheeps[15] &= ~nxt_mask ; 
-        pixs.br1[15] &= ~nxt_mask;
+        spsheeps[15] &= ~nxt_mask ; 
+        field.set_mask(15, nxt_mask, 0);
         ++sps_eaten;
+        ++total_eaten;
     }
     platform_pos = new_pp;
 }
@@ -181,7 +208,7 @@ bool Invation::has_sps()
 {
     for ( int i = 0; i < 16; ++i )
     {
-        if (arena.invation.spsheeps[i]) return true;
+        if (spsheeps[i]) return true;
     }
     return false;
 }
@@ -191,7 +218,7 @@ Invation::GameStatus Invation::tick()
     switch ( phase )
     {
         case 0: 
-            if (arena.invation.spsheeps[15]) return Blast;
+            if (spsheeps[15]) return Blast;
             if (move_sps()) return ImmBlast; break;
         case 1: case 3: move_bullets(); break;
     }
@@ -200,51 +227,45 @@ Invation::GameStatus Invation::tick()
     return Cont;
 }
 
-Invation::GameStatus Invation::run_internal()
+Invation::GameStatus Invation::update_game(uint8_t keys)
 {
     GameStatus result = Cont;
-    uint8_t perv_btn = 0;
-    memset(&arena.invation, 0, sizeof(arena.invation));
-    arena.invation.spsheeps[0] = bits[get_random() % bits_idx[0]] << 1;
-    while(!result)
-    {
-        auto keys = read_key();
-        clr_keys(K_1|K_2|K_3|K_Hit|K_Up);
-        if (keys & K_1) return Done;
+    clr_keys(K_1|K_2|K_3|K_Hit|K_Up);
+    if (keys & K_1) return Done;
 
-        uint8_t press = ~perv_btn & keys & (K_Left|K_Right);
-        if (press) t2.reset(true);
-        perv_btn = keys;
+    uint8_t press = ~perv_btn & keys & (K_Left|K_Right);
+    if (press) t2.reset(true);
+    perv_btn = keys;
 
-        if ( keys & (K_2 | K_3) )
-        {
-            move_platform(keys & K_3 ? 1 : -1);
-        }
-        else if ( (keys & (K_Left|K_Right)) && t2.tick() )
-        {
-            move_platform(keys & K_Right ? 1 : -1);
-        }
+    if ( keys & (K_2 | K_3) )
+    {
+        move_platform(keys & K_3 ? 1 : -1);
+    }
+    else if ( (keys & (K_Left|K_Right)) && t2.tick() )
+    {
+        move_platform(keys & K_Right ? 1 : -1);
+    }
 
-        if ( t.tick() ) result = tick();
-        if (keys & (K_Hit|K_Up)) fire();
-        if ( level < TotalLevels-2 && sps_eaten >= LevelTreshold )
-        {
-            ++level;
-            t.reinit(CycleTime+level);
-            t2.reinit(CycleTime+level);
-            sps_eaten = 0;
-        }
-        if ( last_row_count >= levels[level].sps_delta )
-        {
-            arena.invation.spsheeps[0] = bits[get_random() % bits_idx[levels[level].max_sps-1]] << 1;
-            last_row_count = 0;
-        }
-        show();
+    if ( t.tick() ) result = tick();
+    if (keys & (K_Hit|K_Up)) fire();
+    if ( level < TotalLevels-2 && sps_eaten >= LevelTreshold )
+    {
+        ++level;
+        t.reinit(CycleTime+level);
+        t2.reinit(CycleTime+level);
+        sps_eaten = 0;
     }
+    if ( last_row_count >= levels[level].sps_delta )
+    {
+        spsheeps[0] = bits[random_below(bits_idx[levels[level].max_sps-1])] << 1;
+        last_row_count = 0;
+    }
+    show();
     return result;
 }
 
-void Invation::final_animate(GameStatus kind)
+// Start final animation. Return false if there is nothing to animate
+bool Invation::start_final(GameStatus kind)
 {
     anim_sps = -1;
     anim_platform = -1;
@@ -252,25 +273,26 @@ void Invation::final_animate(GameStatus kind)
     {
         case ImmBlast: start_animate_platform(); break;
         case Blast: start_animate_sps(); break;
-        default: return;
-    }
-    while ( anim_sps != -1 || anim_platform >= 0 )
-    {
-        for ( ;;)
-        {
-            if (read_key() & K_1) return;
-            if (t2.tick()) break;
-        }
-        if ( anim_sps != -1) animate_sps();
-        if ( anim_platform >= 0 ) animate_platform();
+        default: return false;
     }
+    final = true;
+    return anim_sps != -1 || anim_platform >= 0;
+}
+
+// One frame of final animation. Return false when it is done
+bool Invation::update_final(uint8_t keys)
+{
+    if (keys & K_1) return false;
+    if (!t2.tick()) return true;
+    if ( anim_sps != -1) animate_sps();
+    if ( anim_platform >= 0 ) animate_platform();
+    return anim_sps != -1 || anim_platform >= 0;
 }
 
 void Invation::start_animate_platform()
 {
     uint8_t sh_mask = 7 << (platform_pos-1);
-    pixs.br1[15] |= sh_mask;
-    pixs.br2[15] |= sh_mask;
+    field.set_mask(15, sh_mask, max_br);
     anim_platform = 0;
 }
 
@@ -279,9 +301,9 @@ void Invation::animate_platform()
     auto draw = [this](int color)
     {
         auto prev_row = 15-anim_platform;
-        pixs.set_br(platform_pos, prev_row, color);
-        if (platform_pos-1-anim_platform >= 0) pixs.set_br(platform_pos-1-anim_platform, prev_row, color);
-        if (platform_pos+1+anim_platform < 8) pixs.set_br(platform_pos+1+anim_platform, prev_row, color);
+        field.set_color(platform_pos, prev_row, color);
+        if (platform_pos-1-anim_platform >= 0) field.set_color(platform_pos-1-anim_platform, prev_row, color);
+        if (platform_pos+1+anim_platform < 8) field.set_color(platform_pos+1+anim_platform, prev_row, color);
     };
     draw(0);
     ++anim_platform;
@@ -291,7 +313,7 @@ void Invation::animate_platform()
 
 void Invation::start_animate_sps()
 {
-    anim_sps = sh_idxs[arena.invation.spsheeps[15] >> 1];
+    anim_sps = sh_idxs[spsheeps[15] >> 1];
     animate_sps();
 }
 
@@ -300,8 +322,7 @@ void Invation::animate_sps()
 {
     uint8_t sh_mask = 7 << (platform_pos-1);
     auto val = ships[anim_sps++];
-    pixs.br1[15] = val & 0xFF;
-    pixs.br2[15] = val >> 8;
+    field.set_row(15, val & 0xFF, val >> 8);
     if (anim_platform == -1)
     {
         if ( sh_mask & val )
@@ -310,20 +331,16 @@ void Invation::animate_sps()
         }
         else
         {
-            pixs.br2[15] |= sh_mask;
+            // Add base color 2 to platform pixels
+            field.set_mask(15, sh_mask & ~val, color_br(2));
+            field.set_mask(15, sh_mask & val, color_br(3));
         }
     }
     if ( val == 0 ) anim_sps = -1;
 }
 
 
-void Invation::run()
-{
-    auto result = run_internal();
-    if (result != Done) final_animate(result);
-}
-
-void invation_game()
+Game* create_invation()
 {
-    Invation().run();
+    return arena.create<Invation>();
 }
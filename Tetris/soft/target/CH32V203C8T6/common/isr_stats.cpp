@@ -0,0 +1,66 @@
+#include <stdio.h>
+
+#include "isr_stats.h"
+
+static void print_histogram(const char* name, const Histogram& h)
+{
+    if (!h.count) return;
+    printf("  %s: count %lu, min/avg/max %lu/%lu/%lu cycles\r\n  ", name, (unsigned long)h.count,
+        (unsigned long)h.min, (unsigned long)h.avg(), (unsigned long)h.max);
+    for(int i = 0; i < Histogram::buckets; ++i) printf(" %lu", (unsigned long)h.hist[i]);
+    printf("\r\n");
+}
+
+void print_isr_stats()
+{
+    printf("ISR STATS (%lu cycles per us, histogram bucket N: values < 2^N)\r\n", (unsigned long)cycles_per_us);
+    for(int i = 0; const IsrStats* s = get_isr_stats(i); ++i)
+    {
+        printf("%s\r\n", s->name);
+        print_histogram("latency", s->latency);
+        print_histogram("duration", s->duration);
+    }
+    printf("END\r\n");
+}
+
+// Row Y is bucket Y, bar length is bit length of counter / 3 (so 8 pixels are 2^21 values).
+// Latency is drawn by base color 2, duration - by full brightness
+static void draw_histogram(const Histogram& h, bool latency)
+{
+    for(int y = 0; y < 16; ++y)
+    {
+        int len = (Histogram::bucket(h.hist[y]) + 2) / 3;
+        if (len > 8) len = 8;
+        uint8_t bar = (1 << len) - 1;
+        pixs.set_row(y, latency ? 0 : bar, bar);
+    }
+}
+
+void show_isr_stats()
+{
+    int total = 0;
+    while (get_isr_stats(total)) ++total;
+    if (!total) return;
+    print_isr_stats();
+
+    int idx = 0;
+    bool latency = false;
+    for (;;)
+    {
+        const IsrStats* s = get_isr_stats(idx);
+        draw_histogram(latency ? s->latency : s->duration, latency);
+        auto key = next_frame();
+        clr_keys(-1);
+        if (key & K_1) return;
+        if (key & (K_Left | K_Right))
+        {
+            idx = (idx + (key & K_Right ? 1 : total - 1)) % total;
+            printf("%s %s\r\n", get_isr_stats(idx)->name, latency ? "latency" : "duration");
+        }
+        if (key & (K_Up | K_Down))
+        {
+            latency = !latency;
+            printf("%s %s\r\n", s->name, latency ? "latency" : "duration");
+        }
+    }
+}
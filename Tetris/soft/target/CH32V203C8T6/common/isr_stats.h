@@ -0,0 +1,50 @@
+#pragma once
+
+#include "interface.h"
+
+// Statistics of values (in 'get_cycles' units) with log2 histogram. Cheap enough to be updated in interrupts
+struct Histogram {
+    static constexpr int buckets = 16;
+
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t hist[buckets]; // hist[i] - values of bit length i (hist[0] - zeroes, last bucket - all long values)
+
+    // Bit length of value, limited by last bucket
+    static int bucket(uint32_t v)
+    {
+        int result = 0;
+        if (v >> 16) {v >>= 16; result += 16;}
+        if (v >> 8) {v >>= 8; result += 8;}
+        if (v >> 4) {v >>= 4; result += 4;}
+        if (v >> 2) {v >>= 2; result += 2;}
+        result += v > 1 ? 2 : v;
+        return result < buckets ? result : buckets - 1;
+    }
+
+    void add(uint32_t v)
+    {
+        if (!count || v < min) min = v;
+        if (v > max) max = v;
+        total += v;
+        ++count;
+        ++hist[bucket(v)];
+    }
+    uint32_t avg() const {return count ? uint32_t(total / count) : 0;}
+};
+
+// Always-on statistics of interrupt handler. Collected by platform
+struct IsrStats {
+    const char* name;
+    Histogram latency;  // From hardware event to handler entry (empty if event time is unknown)
+    Histogram duration;
+};
+
+// Implemented by platform. Statistics of interrupt 'idx' (nullptr if there is no such interrupt).
+// Platform may list other time critical code after interrupts (with empty latency)
+const IsrStats* get_isr_stats(int idx);
+
+void print_isr_stats(); // Dump all interrupts statistics by 'printf'
+void show_isr_stats();  // Show histograms on LEDs until K_1 pressed (Left/Right - interrupt, Up/Down - latency/duration)
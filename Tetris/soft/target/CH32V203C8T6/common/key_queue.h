@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+#include "interface.h"
+
+/*
+    Queue of key events.
+    Single producer (platform: scan interrupt or emulator GUI thread) / single consumer (game loop). Lock free.
+    On overflow new events are dropped (and counted)
+*/
+class KeyQueue {
+    static constexpr int size = 32; // Must be power of 2
+
+    KeyEvent events[size];
+    std::atomic<uint8_t> head{0}; // Written by producer only
+    std::atomic<uint8_t> tail{0}; // Written by consumer only
+    uint8_t dropped = 0;
+
+public:
+    // Producer side
+    bool put(const KeyEvent& event)
+    {
+        uint8_t h = head.load(std::memory_order_relaxed);
+        if (uint8_t(h - tail.load(std::memory_order_acquire)) >= size) {++dropped; return false;}
+        events[h & (size-1)] = event;
+        head.store(h+1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool get(KeyEvent& event)
+    {
+        uint8_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        event = events[t & (size-1)];
+        tail.store(t+1, std::memory_order_release);
+        return true;
+    }
+
+    uint8_t total_dropped() const {return dropped;}
+};
+
+extern INSTANCE_LOCAL KeyQueue key_queue;
+
+// Drop pending events and set state of 'read_key' (used by trace replay)
+void restore_keys(uint8_t active);
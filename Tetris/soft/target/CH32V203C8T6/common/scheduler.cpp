@@ -0,0 +1,61 @@
+#include "scheduler.h"
+
+static INSTANCE_LOCAL Task* tasks;         // Started tasks (finished ones are unlinked by 'run_tasks')
+static INSTANCE_LOCAL uint32_t frame;      // 'run_tasks' calls
+static INSTANCE_LOCAL uint16_t key_events; // Consumed key events
+static INSTANCE_LOCAL uint8_t keys;        // Physical keys state
+
+void Task::await_ticks(uint32_t ticks)
+{
+    wait = Wait::Ticks;
+    wake_frame = frame + ticks;
+}
+
+void Task::await_key()
+{
+    wait = Wait::Key;
+    key_events = ::key_events;
+}
+
+bool Task::runnable() const
+{
+    switch (wait)
+    {
+        case Wait::Ticks: return int32_t(frame - wake_frame) >= 0;
+        case Wait::Key: return key_events != ::key_events;
+        default: return false;
+    }
+}
+
+void task_start(Task& task)
+{
+    task.resume = 0;
+    task.await_ticks(1);
+    for(Task* t = tasks; t; t = t->next) if (t == &task) return;
+    task.next = tasks;
+    tasks = &task;
+}
+
+void task_stop(Task& task)
+{
+    task.finish();
+}
+
+void run_tasks()
+{
+    ++frame;
+    for(Task** link = &tasks; *link;)
+    {
+        Task& task = **link;
+        if (task.runnable()) task.body(task);
+        if (task.done()) *link = task.next; else link = &task.next;
+    }
+}
+
+uint8_t pressed_keys() {return keys;}
+
+void task_key_event(const KeyEvent& event)
+{
+    if (event.press) keys |= event.key; else keys &= ~event.key;
+    ++key_events;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "interface.h"
+
+/*
+    Cooperative task scheduler.
+    Tasks are protothreads (like 'BigLED/fw/includes/threads.h'). All of them are resumed by 'next_frame' once per
+    frame, so they run while game loop waits for next frame. When no task is runnable CPU sleeps in 'wait_vsync'
+    (__WFI on device).
+
+    Resume point is kept as 'switch' case label (__LINE__), not as label address - emulator compiler (MSVC) has no
+    labels-as-values. So TASK_AWAIT_* can't be used inside 'switch' statement of task body.
+
+    Tasks must not use 'get_random' and consume key events - it will break trace replay (see 'trace.h').
+
+How to use:
+
+struct Blinker : Task {
+    uint8_t x; // Automatic variables loose they values at await points, so keep state in task
+
+    Blinker() : Task(body) {}
+
+    static void body(Task& task)
+    {
+        auto& self = static_cast<Blinker&>(task);
+        TASK_BEGIN(task);
+        for(self.x = 0;; self.x = (self.x + 1) & 7)
+        {
+            pixs.set_color(self.x, 0, 3);
+            TASK_AWAIT_TICKS(task, 10);   // Wait for 10 frames
+            TASK_AWAIT_KEY(task);         // Wait for any key press or release, see 'pressed_keys'
+            if (pressed_keys() & K_1) break;
+        }
+        TASK_END(task);  // Task is finished and removed from scheduler
+    }
+};
+
+static Blinker blinker;
+task_start(blinker);
+*/
+
+class Task {
+public:
+    using Body = void (*)(Task&);
+
+    explicit Task(Body body) : body(body) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    bool done() const {return wait == Wait::Done;}
+
+    // Used by TASK_* macros
+    uint16_t resume = 0;                // Resume point (0 - start of body)
+    void await_ticks(uint32_t ticks);   // Resume after 'ticks' frames
+    void await_key();                   // Resume after next key event
+    void finish() {wait = Wait::Done;}
+
+private:
+    enum class Wait : uint8_t {Ticks, Key, Done};
+
+    Body body;
+    Task* next = nullptr;
+    Wait wait = Wait::Done;
+    uint16_t key_events;    // Key events counter on start of wait
+    uint32_t wake_frame;
+
+    bool runnable() const;
+
+    friend void task_start(Task&);
+    friend void run_tasks();
+};
+
+#define TASK_BEGIN(task) switch ((task).resume) { case 0:
+#define TASK_AWAIT_(task, setup) do { (task).resume = __LINE__; (task).setup; return; case __LINE__:; } while(0)
+#define TASK_AWAIT_FRAME(task) TASK_AWAIT_(task, await_ticks(1))
+#define TASK_AWAIT_TICKS(task, ticks) TASK_AWAIT_(task, await_ticks(ticks))
+#define TASK_AWAIT_KEY(task) TASK_AWAIT_(task, await_key())
+#define TASK_END(task) } (task).finish()
+
+void task_start(Task& task);    // (Re)start task from beginning of body. Task body is called first time on next frame
+void task_stop(Task& task);
+void run_tasks();               // Resume all runnable tasks. Called by 'next_frame'
+
+uint8_t pressed_keys();                     // Physical state of keys (not affected by 'clr_keys')
+void task_key_event(const KeyEvent& event); // Hook for common code. Called for every consumed key event
@@ -1,8 +1,9 @@
 #include "interface.h"
 #include "arena.h"
 #include "timer.h"
+#include "game.h"
 
-class Snake {
+class Snake : public Game {
     static constexpr int max_level = 10;
     static constexpr int items_per_level = 8;
 
@@ -22,7 +23,7 @@ class Snake {
         if (expect <= bricks) return false;
         auto delta = expect - bricks;
         if (delta >= 5) return true;
-        return get_random() % ((5-delta)*10) == 0;
+        return random_below((5-delta)*10) == 0;
     }
 
     enum Direction {
@@ -56,45 +57,51 @@ class Snake {
             }
             return true;
         }
-
-        uint16_t combine() const {return x+y*8;}
     };
 
     int level = 1; // Freqency in Hz
 
-    uint16_t snake_head=0, snake_tail=0;
+    // Snake body: tail cell + ring of 2-bit directions of moves from tail to head
+    // (up to 128 cells of 8*16 board)
+    uint8_t* body = arena.alloc<uint8_t, 32>();
+    uint8_t snake_head=0, snake_tail=0;
+    Coord tail_coord;
     int body_len_increment = 0;
+    uint32_t food_eaten = 0; // Score
     Timer timer = 1;
     uint8_t bricks=0;
     Direction dir = D_Up;
     Coord coord = {4, 8};
+    Pixels field;
+    Bitboard occupied = {}; // Snake, food and bricks
 
-    static uint16_t inc(uint16_t& idx) {++idx; idx &= 511; return idx;}
-
-    void snake_push_head(Coord coord)
+    // Head moved in direction 'dir'
+    void snake_push_head(Direction dir)
     {
-        arena.snake.body[inc(snake_head)] = coord.combine();
+        uint8_t& cell = body[snake_head / 4];
+        uint8_t shift = snake_head % 4 * 2;
+        cell = (cell & ~(3 << shift)) | (dir << shift);
+        snake_head = (snake_head + 1) & 127;
     }
 
+    // Remove tail cell and return it
     Coord snake_pop_tail()
     {
-        return arena.snake.body[inc(snake_tail)];
+        Coord result = tail_coord;
+        tail_coord.move(Direction((body[snake_tail / 4] >> (snake_tail % 4 * 2)) & 3));
+        snake_tail = (snake_tail + 1) & 127;
+        return result;
     }
 
-    static void draw(Coord coord, Color color)
+    void draw(Coord coord, Color color)
     {
-        pixs.set_br(coord.x, coord.y, color);
-        // uint8_t mask = 1 << coord.x;
-        // if (color & 1) pixs.br1[coord.y] |= mask; else pixs.br1[coord.y] &= ~mask;
-        // if (color & 2) pixs.br2[coord.y] |= mask; else pixs.br2[coord.y] &= ~mask;
+        field.set_color(coord.x, coord.y, color);
+        if (color) occupied.set(coord.x, coord.y); else occupied.reset(coord.x, coord.y);
     }
 
-    static Color fetch(Coord coord)
+    Color fetch(Coord coord) const
     {
-        return Color(pixs.get_br(coord.x, coord.y));
-        // uint8_t p1 = (pixs.br1[coord.y] >> coord.x) & 1;
-        // uint8_t p2 = (pixs.br2[coord.y] >> coord.x) & 1;
-        // return Color(p1 + p2*2);
+        return Color(field.get_color(coord.x, coord.y));
     }
 
     enum CanMove {
@@ -120,11 +127,12 @@ class Snake {
     {
         auto status = move_head();
         if (status == CM_No) return false;
-        snake_push_head(coord);
+        snake_push_head(dir);
         draw(coord, C_Snake);
         if (status == CM_Food)
         {
             ++body_len_increment;
+            ++food_eaten;
             if (body_len_increment >= items_per_level)
             {
                 body_len_increment = 0;
@@ -143,69 +151,72 @@ class Snake {
         return true;
     }
 
-    // Put 1 pixel in random position
-    // Do not put in any occupied position and in position of head movement
-    void put_in_random(Color color)
+    // Cells in position of head movement (from head to border)
+    Bitboard head_path() const
     {
-        for (;;)
+        Bitboard result = {};
+        switch (dir)
         {
-            uint16_t x = get_random() & 7;
-            uint16_t y = get_random() & 15;
-            if (fetch(Coord(x,y))) continue; // Occupied
-            if (x == coord.x) // Check up/down
-            {
-                switch (dir)
-                {
-                    case D_Up: if (y<=coord.y) continue; break;
-                    case D_Down: if (y>=coord.y) continue; break;
-                }
-            }
-            else if (y == coord.y) // Check left/right
-            {
-                switch (dir)
-                {
-                    case D_Left: if (x <= coord.x) continue; break;
-                    case D_Right: if (x >= coord.x) continue; break;
-                }
-            }
-            draw(Coord(x, y), color);
-            break;
+            case D_Up: for (int y = 0; y <= coord.y; ++y) result.set(coord.x, y); break;
+            case D_Down: for (int y = coord.y; y < 16; ++y) result.set(coord.x, y); break;
+            case D_Left: for (int x = 0; x <= coord.x; ++x) result.set(x, coord.y); break;
+            case D_Right: for (int x = coord.x; x < 8; ++x) result.set(x, coord.y); break;
         }
+        return result;
+    }
+
+    // Put 1 pixel in random position (uniformly, in bounded time)
+    // Do not put in any occupied position and in position of head movement
+    void put_in_random(Color color)
+    {
+        Bitboard path = head_path();
+        Bitboard free;
+        for (int k = 0; k < 4; ++k) free.w[k] = ~(occupied.w[k] | path.w[k]);
+        int total = free.count();
+        if (!total) return; // No room
+        draw(Coord(free.select(random_below(total))), color);
     }
 
 public:
     Snake()
     {
-        snake_push_head(coord);
+        field.clear();
+        tail_coord = coord;
         draw(coord, C_Snake);
         put_in_random(C_Food);
     }
 
-    void run()
+    bool update(const FrameInput& input) override
     {
-        for (;;)
+        // Key presses of this frame, in order (held key does not repeat)
+        for (int i = 0; int key = input.next_press(i);)
         {
-            auto key = read_key();
-            clr_keys(key);
-            if (key & K_3) return;
-            key &= K_Up | K_Down | K_Left | K_Right;
             switch (key)
             {
+                case K_3:       return false;
                 case K_Up:      if (dir != D_Down) dir = D_Up; break;
                 case K_Down:    if (dir != D_Up) dir = D_Down; break;
                 case K_Left:    if (dir != D_Right) dir = D_Left; break;
                 case K_Right:   if (dir != D_Left) dir = D_Right; break;
             }
-            if (timer.tick())
-            {
-                if (!move_snake()) return;
-                if (need_put_brick()) {++bricks; put_in_random(C_Brick);}
-            }
         }
+        if (timer.tick())
+        {
+            if (!move_snake()) return false;
+            if (need_put_brick()) {++bricks; put_in_random(C_Brick);}
+        }
+        return true;
+    }
+
+    uint32_t score() const override {return food_eaten;}
+
+    void render(Pixels& dst) override
+    {
+        dst = field;
     }
 };
 
-void snake_game()
+Game* create_snake()
 {
-    Snake().run();
+    return arena.create<Snake>();
 }
\ No newline at end of file
@@ -0,0 +1,192 @@
+#include "game.h"
+#include "timeline.h"
+#include "arena.h"
+
+/*
+    Snake autoplayer. Plays by picture only (bricks, snake and food have different colors, see 'Snake'), all board
+    work is done on 128-bit bitboards, whole rows at once.
+    Snake body is tracked by picture changes: cell which appears next to head is new head, cells which disappear are
+    taken from tail. So bot should be created before game start.
+
+    On every head move next direction is chosen from 3 candidates (no reverse, no walls/bricks/body; tail cell is
+    obstacle too - game checks collision before tail moves):
+      - BFS from food gives distance from each candidate to food
+      - flood fill from candidate (with candidate cell occupied) gives room left after move; move is safe when whole
+        body fits in that room
+    Nearest to food safe move wins, without safe moves - one with biggest room.
+    Direction key is held until next move (game takes direction from held keys).
+*/
+class SnakeBot : public Autoplayer {
+    uint8_t body[128];      // Ring of cell positions (x + y*8), tail first
+    uint8_t tail, length;   // Ring start and size
+    Bitboard last_snake;    // Snake cells on previous screen
+    uint8_t key;            // Chosen direction
+    uint8_t back;           // Reverse of last move (ignored by game), index in 'dir_keys'
+
+    uint8_t head() const {return body[(tail + length - 1) & 127];}
+    void track(const Bitboard& snake);
+    void plan(const Bitboard& obstacles, const Bitboard& food);
+
+public:
+    uint8_t keys(const Pixels& screen) override;
+};
+
+static const uint8_t dir_keys[4] = {K_Up, K_Down, K_Left, K_Right}; // Reverse direction is 'd ^ 1'
+static const int8_t dx[4] = {0, 0, -1, 1};
+static const int8_t dy[4] = {-1, 1, 0, 0};
+
+static Bitboard cell(int pos)
+{
+    Bitboard result = {};
+    result.w[pos / 32] = 1u << (pos % 32);
+    return result;
+}
+
+static bool empty(const Bitboard& b) {return !(b.w[0] | b.w[1] | b.w[2] | b.w[3]);}
+static bool intersects(const Bitboard& a, const Bitboard& b)
+{
+    return (a.w[0] & b.w[0]) | (a.w[1] & b.w[1]) | (a.w[2] & b.w[2]) | (a.w[3] & b.w[3]);
+}
+
+// Cells next to cells of 'b' (4-connected) and 'b' itself, within 'allowed'
+static Bitboard grow(const Bitboard& b, const Bitboard& allowed)
+{
+    Bitboard result;
+    for (int k = 0; k < 4; ++k)
+    {
+        uint32_t v = b.w[k];
+        uint32_t r = v | ((v << 1) & ~0x01010101u) | ((v >> 1) & ~0x80808080u) | (v << 8) | (v >> 8);
+        if (k) r |= b.w[k - 1] >> 24;
+        if (k < 3) r |= b.w[k + 1] << 24;
+        result.w[k] = r & allowed.w[k];
+    }
+    return result;
+}
+
+// Cells reachable from 'start' through 'allowed'
+static Bitboard flood(Bitboard start, const Bitboard& allowed)
+{
+    for (;;)
+    {
+        Bitboard next = grow(start, allowed);
+        if (!memcmp(&next, &start, sizeof(next))) return start;
+        start = next;
+    }
+}
+
+// Add new head cells (next to old head, in order) and drop vanished tail cells
+void SnakeBot::track(const Bitboard& snake)
+{
+    Bitboard added, vanished;
+    for (int k = 0; k < 4; ++k)
+    {
+        added.w[k] = snake.w[k] & ~last_snake.w[k];
+        vanished.w[k] = last_snake.w[k] & ~snake.w[k];
+    }
+    last_snake = snake;
+    for (int n = vanished.count(); n-- && length;)
+    {
+        tail = (tail + 1) & 127;
+        --length;
+    }
+    while (!empty(added))
+    {
+        Bitboard next = added;
+        if (length)
+        {
+            Bitboard near = grow(cell(head()), added);
+            if (!empty(near)) next = near;
+        }
+        int pos = next.select(0);
+        body[(tail + length) & 127] = pos;
+        ++length;
+        added.reset(pos % 8, pos / 8);
+    }
+}
+
+void SnakeBot::plan(const Bitboard& obstacles, const Bitboard& food)
+{
+    TRACE_BEGIN(TP_BotSearch);
+    uint32_t start = get_cycles();
+
+    int hx = head() % 8, hy = head() / 8;
+
+    Bitboard free;
+    for (int k = 0; k < 4; ++k) free.w[k] = ~obstacles.w[k];
+
+    struct Candidate {
+        Bitboard cell;
+        int dist;   // To food, -1 - not reachable
+        int room;   // Free cells reachable after move
+    } cand[4];
+    int total = 0;
+    uint8_t cand_dir[4];
+    for (int d = 0; d < 4; ++d)
+    {
+        int x = hx + dx[d], y = hy + dy[d];
+        if (d == back || x < 0 || x > 7 || y < 0 || y > 15 || !free.get(x, y)) continue;
+        Candidate& c = cand[total];
+        c.cell = cell(x + y * 8);
+        c.dist = -1;
+        Bitboard after = free;
+        after.reset(x, y);
+        if (!intersects(c.cell, food)) after.set(body[tail] % 8, body[tail] / 8); // Tail moves away, snake grows on food
+        c.room = flood(grow(c.cell, after), after).count();
+        cand_dir[total++] = d;
+    }
+
+    // BFS from food: distance to candidate is layer where it is reached
+    Bitboard reached = food;
+    int found = 0;
+    for (int dist = 0; found < total && !empty(reached); ++dist)
+    {
+        for (int i = 0; i < total; ++i)
+        {
+            if (cand[i].dist < 0 && intersects(cand[i].cell, reached)) {cand[i].dist = dist; ++found;}
+        }
+        Bitboard next = grow(reached, free);
+        if (!memcmp(&next, &reached, sizeof(next))) break;
+        reached = next;
+    }
+
+    int best = -1;
+    auto better = [&](const Candidate& a, const Candidate& b)
+    {
+        bool safe_a = a.room >= length, safe_b = b.room >= length;
+        if (safe_a != safe_b) return safe_a;
+        if (!safe_a) return a.room > b.room;
+        if ((a.dist >= 0) != (b.dist >= 0)) return a.dist >= 0;
+        if (a.dist >= 0 && a.dist != b.dist) return a.dist < b.dist;
+        return a.room > b.room;
+    };
+    for (int i = 0; i < total; ++i) if (best < 0 || better(cand[i], cand[best])) best = i;
+    key = best < 0 ? 0 : dir_keys[cand_dir[best]];
+
+    search.add(get_cycles() - start);
+    TRACE_END(TP_BotSearch);
+}
+
+uint8_t SnakeBot::keys(const Pixels& screen)
+{
+    Bitboard snake = screen.br_mask(color_br(2));
+    if (!memcmp(&snake, &last_snake, sizeof(snake))) return key;
+    int old_head = length ? head() : -1;
+    track(snake);
+    if (!length || head() == old_head) return key;
+    if (old_head < 0) back = 1; // Snake starts moving up
+    for (int d = 0; d < 4; ++d)
+    {
+        if (old_head >= 0 && old_head % 8 + dx[d] == head() % 8 && old_head / 8 + dy[d] == head() / 8) back = d ^ 1;
+    }
+
+    Bitboard food = screen.br_mask(color_br(3));
+    Bitboard obstacles = screen.occupancy();
+    for (int k = 0; k < 4; ++k) obstacles.w[k] &= ~food.w[k];
+    plan(obstacles, food);
+    return key;
+}
+
+Autoplayer* create_snake_bot()
+{
+    return arena.create<SnakeBot>();
+}
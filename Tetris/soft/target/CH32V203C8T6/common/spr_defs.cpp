@@ -4,122 +4,164 @@ const SpriteDef sprites[] = {
 //  < 
 // ***
   {0x2, 3, 2, 3, 1},
-  {0x38, 3, 2, 3, 1},
+  {0x700, 3, 2, 3, 1},
 //  * 
 // ***
   {0x0, 3, 2, 0, 1},
-  {0x3A, 3, 2, 0, 1},
+  {0x702, 3, 2, 0, 1},
 //  > 
 // ***
   {0x2, 3, 2, 0, 1},
-  {0x3A, 3, 2, 0, 1},
+  {0x702, 3, 2, 0, 1},
 //  * 
 // ***
   {0x0, 3, 2, 0, 1},
-  {0x3A, 3, 2, 0, 1},
+  {0x702, 3, 2, 0, 1},
 // *
   {0x1, 1, 1, 0, 0},
 // **
   {0x3, 2, 1, 1, 0},
 // *
 // *
-  {0x3, 1, 2, 0, 0},
+  {0x101, 1, 2, 0, 0},
 // ***
   {0x7, 3, 1, 1, 0},
 // *
 // *
 // *
-  {0x7, 1, 3, 0, 0},
+  {0x10101, 1, 3, 0, 0},
 // * 
 // **
-  {0xD, 2, 2, 3, 0},
+  {0x301, 2, 2, 3, 0},
 // **
 // * 
-  {0x7, 2, 2, 0, 0},
+  {0x103, 2, 2, 0, 0},
 // **
 //  *
-  {0xB, 2, 2, 0, 0},
+  {0x203, 2, 2, 0, 0},
 //  *
 // **
-  {0xE, 2, 2, 0, 0},
+  {0x302, 2, 2, 0, 0},
 // **
 // * 
-  {0x7, 2, 2, 3, 0},
+  {0x103, 2, 2, 3, 0},
 // **
 //  *
-  {0xB, 2, 2, 0, 0},
+  {0x203, 2, 2, 0, 0},
 //  *
 // **
-  {0xE, 2, 2, 0, 0},
+  {0x302, 2, 2, 0, 0},
 // * 
 // **
-  {0xD, 2, 2, 0, 0},
+  {0x301, 2, 2, 0, 0},
 // ****
   {0xF, 4, 1, 1, 0},
 // *
 // *
 // *
 // *
-  {0xF, 1, 4, 0, 0},
+  {0x1010101, 1, 4, 0, 0},
 // *  
 // ***
-  {0x39, 3, 2, 3, 0},
+  {0x701, 3, 2, 3, 0},
 // **
 // * 
 // * 
-  {0x17, 2, 3, 0, 0},
+  {0x10103, 2, 3, 0, 0},
 // ***
 //   *
-  {0x27, 3, 2, 0, 0},
+  {0x407, 3, 2, 0, 0},
 //  *
 //  *
 // **
-  {0x3A, 2, 3, 0, 0},
+  {0x30202, 2, 3, 0, 0},
 // ***
 // *  
-  {0xF, 3, 2, 3, 0},
+  {0x107, 3, 2, 3, 0},
 // **
 //  *
 //  *
-  {0x2B, 2, 3, 0, 0},
+  {0x20203, 2, 3, 0, 0},
 //   *
 // ***
-  {0x3C, 3, 2, 0, 0},
+  {0x704, 3, 2, 0, 0},
 // * 
 // * 
 // **
-  {0x35, 2, 3, 0, 0},
+  {0x30101, 2, 3, 0, 0},
 // ** 
 //  **
-  {0x33, 3, 2, 1, 0},
+  {0x603, 3, 2, 1, 0},
 //  *
 // **
 // * 
-  {0x1E, 2, 3, 0, 0},
+  {0x10302, 2, 3, 0, 0},
 //  **
 // ** 
-  {0x1E, 3, 2, 1, 0},
+  {0x306, 3, 2, 1, 0},
 // * 
 // **
 //  *
-  {0x2D, 2, 3, 0, 0},
+  {0x20301, 2, 3, 0, 0},
 // ***
 //  * 
-  {0x17, 3, 2, 3, 0},
+  {0x207, 3, 2, 3, 0},
 //  *
 // **
 //  *
-  {0x2E, 2, 3, 0, 0},
+  {0x20302, 2, 3, 0, 0},
 //  * 
 // ***
-  {0x3A, 3, 2, 0, 0},
+  {0x702, 3, 2, 0, 0},
 // * 
 // **
 // * 
-  {0x1D, 2, 3, 0, 0},
+  {0x10301, 2, 3, 0, 0},
 // **
 // **
-  {0xF, 2, 2, 0, 0},
+  {0x303, 2, 2, 0, 0},
+};
+const uint32_t sprite_columns[][8] = {
+  {0, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0},
+  {0, 0x700, 0xE00, 0x1C00, 0x3800, 0x7000, 0xE000, 0},
+  {0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0},
+  {0, 0x702, 0xE04, 0x1C08, 0x3810, 0x7020, 0xE040, 0},
+  {0, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0},
+  {0, 0x702, 0xE04, 0x1C08, 0x3810, 0x7020, 0xE040, 0},
+  {0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0},
+  {0, 0x702, 0xE04, 0x1C08, 0x3810, 0x7020, 0xE040, 0},
+  {0x1, 0x2, 0x4, 0x8, 0x10, 0x20, 0x40, 0x80},
+  {0, 0x3, 0x6, 0xC, 0x18, 0x30, 0x60, 0xC0},
+  {0x101, 0x202, 0x404, 0x808, 0x1010, 0x2020, 0x4040, 0x8080},
+  {0, 0x7, 0xE, 0x1C, 0x38, 0x70, 0xE0, 0},
+  {0x10101, 0x20202, 0x40404, 0x80808, 0x101010, 0x202020, 0x404040, 0x808080},
+  {0, 0x301, 0x602, 0xC04, 0x1808, 0x3010, 0x6020, 0xC040},
+  {0, 0x103, 0x206, 0x40C, 0x818, 0x1030, 0x2060, 0x40C0},
+  {0, 0x203, 0x406, 0x80C, 0x1018, 0x2030, 0x4060, 0x80C0},
+  {0, 0x302, 0x604, 0xC08, 0x1810, 0x3020, 0x6040, 0xC080},
+  {0, 0x103, 0x206, 0x40C, 0x818, 0x1030, 0x2060, 0x40C0},
+  {0, 0x203, 0x406, 0x80C, 0x1018, 0x2030, 0x4060, 0x80C0},
+  {0, 0x302, 0x604, 0xC08, 0x1810, 0x3020, 0x6040, 0xC080},
+  {0, 0x301, 0x602, 0xC04, 0x1808, 0x3010, 0x6020, 0xC040},
+  {0, 0, 0xF, 0x1E, 0x3C, 0x78, 0xF0, 0},
+  {0x1010101, 0x2020202, 0x4040404, 0x8080808, 0x10101010, 0x20202020, 0x40404040, 0x80808080},
+  {0, 0x701, 0xE02, 0x1C04, 0x3808, 0x7010, 0xE020, 0},
+  {0, 0x10103, 0x20206, 0x4040C, 0x80818, 0x101030, 0x202060, 0x4040C0},
+  {0, 0x407, 0x80E, 0x101C, 0x2038, 0x4070, 0x80E0, 0},
+  {0, 0x30202, 0x60404, 0xC0808, 0x181010, 0x302020, 0x604040, 0xC08080},
+  {0, 0x107, 0x20E, 0x41C, 0x838, 0x1070, 0x20E0, 0},
+  {0, 0x20203, 0x40406, 0x8080C, 0x101018, 0x202030, 0x404060, 0x8080C0},
+  {0, 0x704, 0xE08, 0x1C10, 0x3820, 0x7040, 0xE080, 0},
+  {0, 0x30101, 0x60202, 0xC0404, 0x180808, 0x301010, 0x602020, 0xC04040},
+  {0, 0x603, 0xC06, 0x180C, 0x3018, 0x6030, 0xC060, 0},
+  {0, 0x10302, 0x20604, 0x40C08, 0x81810, 0x103020, 0x206040, 0x40C080},
+  {0, 0x306, 0x60C, 0xC18, 0x1830, 0x3060, 0x60C0, 0},
+  {0, 0x20301, 0x40602, 0x80C04, 0x101808, 0x203010, 0x406020, 0x80C040},
+  {0, 0x207, 0x40E, 0x81C, 0x1038, 0x2070, 0x40E0, 0},
+  {0, 0x20302, 0x40604, 0x80C08, 0x101810, 0x203020, 0x406040, 0x80C080},
+  {0, 0x702, 0xE04, 0x1C08, 0x3810, 0x7020, 0xE040, 0},
+  {0, 0x10301, 0x20602, 0x40C04, 0x81808, 0x103010, 0x206020, 0x40C040},
+  {0, 0x303, 0x606, 0xC0C, 0x1818, 0x3030, 0x6060, 0xC0C0},
 };
 const uint8_t logos[] = {
    0x04,0x04,0x04,0x04,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x04,0x04,0x04,0x04,0x00,0x00,0x1B,0x37,0x3B,0x2A,0x37,0x1B,0x17,0x3B, /*tetris*/
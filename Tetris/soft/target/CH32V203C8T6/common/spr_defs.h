@@ -1,11 +1,6 @@
 #pragma once
 constexpr int total_tetris_figures = 12;
-enum Logos {
-  Logo_tetris,
-  Logo_snake,
-  Logo_invation,
-  LogosTotal
-};
+constexpr int total_logos = 3;
 enum Sprites {
     Sprite_platform = 0,
 };
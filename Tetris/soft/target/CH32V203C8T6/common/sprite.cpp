@@ -19,73 +19,68 @@ bool Sprite::place(int x, int y, int rotation, SprColor color)
     return !collition;
 }
 
-int Sprite::process(uint32_t spr1_data, uint32_t spr2_data, Sprite::Functor func)
-{    
-    const SpriteDef& S = spr();
-    uint8_t* b1 = &pixs.br1[spr_y - S.height / 2];
-    uint8_t* b2 = &pixs.br2[spr_y - S.height / 2];
-    int result = 0;
-    uint8_t mask = (1 << S.width) - 1;
-    uint8_t shift = spr_x - S.width / 2;
-    uint8_t data_mask = mask << shift;
-    for (int row = 0; row < S.height; ++row, ++b1, ++b2)
-    {
-        result |= func(*b1, *b2, data_mask, (spr1_data & mask) << shift, (spr2_data & mask) << shift);
-        spr1_data >>= S.width;
-        spr2_data >>= S.width;
-    }
+// Sprite data is already in bitboard layout and at its column, so it is moved to its row by one shift.
+// Sprite of up to 4 rows covers 1 or 2 bitboard words
+template<typename Functor>
+int Sprite::process(uint32_t spr1_data, uint32_t spr2_data, Functor func) const
+{
+    int y = spr_y - spr().height / 2;
+    int w = y / 4;
+    int shift = y % 4 * 8;
+    uint64_t d1 = uint64_t(spr1_data) << shift;
+    uint64_t d2 = uint64_t(spr2_data) << shift;
+    int result = func(w, uint32_t(d1), uint32_t(d2));
+    if ((d1 | d2) >> 32) result |= func(w + 1, uint32_t(d1 >> 32), uint32_t(d2 >> 32));
     return result;
 }
 
-
-bool Sprite::check_collitions()
+bool Sprite::check_collitions() const
 {
     const SpriteDef& S = spr();
     if (spr_x < int(S.width/2) || spr_y < int(S.height/2) || spr_x+S.width-S.width/2 > 8 || spr_y + S.height - S.height/2 > 16) return true;
-    uint32_t spr_mask = combined_spr_mask();
-
-    return process(spr_mask, spr_mask, [](uint8_t& b1, uint8_t& b2, uint8_t, uint8_t d1, uint8_t d2) ->int {
-        return (b1|b2) & (d1|d2);
+    return process(combined_spr_mask(), 0, [this](int w, uint32_t d1, uint32_t) ->int {
+        return (board->word_mask(w) & d1) != 0;
     }) != 0;
 }
 
 void Sprite::clear_sprite()
 {
-    uint32_t spr_mask = combined_spr_mask();
-    process(spr_mask, spr_mask, [](uint8_t& b1, uint8_t& b2, uint8_t, uint8_t d1, uint8_t d2) ->int {
-        b1 &= ~d1;
-        b2 &= ~d2;
+    process(combined_spr_mask(), 0, [this](int w, uint32_t d1, uint32_t) ->int {
+        for (int p = 0; p < bitplanes; ++p) board->planes[p].w[w] &= ~d1;
         return 0;
     });
 }
 
 void Sprite::draw_sprite(SprColor color)
 {
-    const SpriteDef& S = spr();
-    if (color == SC_On && !S.is_gs) color = SC_Full;
+    if (color == SC_On && !spr().is_gs) color = SC_Full;
     uint32_t data1=0, data2=0;
     switch (color)
     {
-        case SC_1: data1 = S.pixels; break;
-        case SC_2: data2 = S.pixels; break;
-        case SC_Full: data1 = data2 = S.pixels; break;
-        case SC_On: data1 = S.pixels; data2 = spr2().pixels; break;
+        case SC_1: data1 = columns(); break;
+        case SC_2: data2 = columns(); break;
+        case SC_Full: data1 = data2 = columns(); break;
+        case SC_On: data1 = columns(); data2 = columns(1); break;
         default: assert(false); break; // Should never happened!
     }
-    process(data1, data2, [](uint8_t& b1, uint8_t& b2, uint8_t mask, uint8_t d1, uint8_t d2) ->int {
-        mask &= d1 | d2;
-        b1 = (b1 & ~mask) | d1;
-        b2 = (b2 & ~mask) | d2;
+    process(data1, data2, [this](int w, uint32_t d1, uint32_t d2) ->int {
+        uint32_t mask = d1 | d2;
+        for (int p = 0; p < bitplanes; ++p)
+        {
+            board->planes[p].w[w] = (board->planes[p].w[w] & ~mask) | Pixels::plane_bits(p, d1, d2);
+        }
         return 0;
     });
 }
 
+// 'move' steps rotation by one, so it is wrapped without division (this is hot path)
 void Sprite::set_rotation(int new_rot)
 {
     const SpriteDef& S = bspr();
     int max_sprites = S.group_size+1;
     if (new_rot < 0) new_rot += max_sprites;
-    new_rot %= max_sprites;
+    if (new_rot >= max_sprites) new_rot -= max_sprites;
+    if (unsigned(new_rot) >= unsigned(max_sprites)) new_rot = (new_rot % max_sprites + max_sprites) % max_sprites;
     spr_rotation = new_rot;
     index = base_index + (S.is_gs ? spr_rotation*2 : spr_rotation);
 }
@@ -4,7 +4,7 @@
 
 // Sprite definition. 8 bytes
 struct SpriteDef {
-    uint32_t pixels;
+    uint32_t pixels; // Rows in byte lanes (as in 'Bitboard' word): bit X of byte Y - pixel (X,Y). Up to 8x4 pixels
     uint8_t width:4;
     uint8_t height:4;
     uint8_t group_size:2; // 0 to 3 next sprites forms Group of sprites (switched by 'rotate' parameter)
@@ -14,20 +14,22 @@ struct SpriteDef {
 };
 
 extern const SpriteDef sprites[];
+extern const uint32_t sprite_columns[][8]; // Pixels of sprite moved to column X, 0 if it does not fit (see 'sgen.py')
 extern const int tetris_figures[];
 extern const uint8_t logos[];
 extern const uint8_t logos_entries[];
 
 enum SprColor {
     SC_Off, // Turn off
-    SC_1,   // Turn 1/3 of full brightness
-    SC_2,   // Turn 2/3 of full brightness
+    SC_1,   // Turn on with base color 1 (dim, see 'color_br')
+    SC_2,   // Turn on with base color 2 (medium)
     SC_Full,  // Turn fully on
     SC_On, // Use brigtness info from SpriteDef (same as SC_Full for non-GS sprites)
     SC_NoChange // Do not change color status (used for 'place' call of active sprite)
 };
 
 class Sprite {
+    Pixels* board;
     int base_index;
     int index;
     int spr_x=0, spr_y=0, spr_rotation=0;
@@ -35,23 +37,25 @@ class Sprite {
 
     const SpriteDef& spr2() const { return sprites[index+1]; }
 
-    bool check_collitions();
+    bool check_collitions() const;
     void clear_sprite();
     void draw_sprite(SprColor color);
     void set_rotation(int);
 
+    // Sprite pixels at its column (see 'sprite_columns'). 'plane' is 1 for second plane of GS sprite
+    uint32_t columns(int plane = 0) const { return sprite_columns[index+plane][spr_x]; }
     uint32_t combined_spr_mask() const {
-        uint32_t spr_mask = spr().pixels;
-        if (spr().is_gs) spr_mask |= spr2().pixels;
+        uint32_t spr_mask = columns();
+        if (spr().is_gs) spr_mask |= columns(1);
         return spr_mask;
     }
 
-    using Functor = int(uint8_t& b1, uint8_t& b2, uint8_t, uint8_t d1, uint8_t d2);
-
-    int process(uint32_t, uint32_t, Functor);
+    // Called for each bitboard word covered by sprite (1 or 2 calls): func(word index, word of data1, word of data2)
+    template<typename Functor>
+    int process(uint32_t, uint32_t, Functor func) const;
 
 public:
-    Sprite(int sprite_index) : base_index(sprite_index), index(sprite_index) {}
+    Sprite(int sprite_index, Pixels& board = pixs) : board(&board), base_index(sprite_index), index(sprite_index) {}
 
     const SpriteDef& spr() const { return sprites[index]; }
     const SpriteDef& bspr() const { return sprites[base_index]; }
@@ -1,6 +1,9 @@
 ﻿#include "sprite.h"
 #include "spr_defs.h"
 #include "timer.h"
+#include "game.h"
+#include "arena.h"
+#include "timeline.h"
 
 /* Color map for Tetris:
 
@@ -12,59 +15,110 @@ Full - Active figure
 */
 
 
-class TetrisGame {
+class TetrisGame : public Game {
     static constexpr int max_level = 10;
     static constexpr int fall_down_mult = 10;
     static constexpr int settle_down_mult = 10;
     static constexpr int settle_down_timeout = 2 * settle_down_mult;
     static constexpr int squeeze_mult = 8;
     static constexpr int squeeze_count = 2;
+    static constexpr int squeeze_steps = squeeze_count * 4 + 1;
     static constexpr int lines_per_level = 10;
 
+    enum State : uint8_t {
+        S_Fall,     // Figure falls down
+        S_Settle,   // Figure reached bottom, but still can be moved (blinks)
+        S_Squeeze   // Full lines highlight
+    };
+
+    Pixels field;
+    State state = S_Fall;
     int level = 1; // Freqency in Hz
 
     int collapsed_lines = 0;
-    Sprite figure = 0;
+    uint32_t total_lines = 0; // Score
+    Sprite figure = {0, field};
     Timer timer = 1;
 
-    bool place_figure(); // Retrun true if successfully placed
+    bool color_ff;          // S_Settle: blink phase
+    int countdown;          // S_Settle: blinks till figure settled
+    uint16_t squeeze_mask;  // S_Squeeze: rows to collapse
+    int squeeze_step;       // S_Squeeze: highlight step
+
+    bool new_figure();   // Retrun false if there is no room for new figure
     void process_key(int key);
-    void settle_down();
-    void squeeze();
+    void update_settle(const FrameInput& input);
+    void start_squeeze();
+    void squeeze_fill(int step);
+    void collapse();
 
 public:
+    TetrisGame()
+    {
+        field.clear();
+        new_figure();
+    }
 
-    void run()
+    bool update(const FrameInput& input) override
     {
-        while(place_figure())
+        switch (state)
         {
-            timer.reinit(level);
-            for (;;)
-            {
-                auto key = read_key();
-                clr_keys(-1);
-                process_key(key);
-                if (key & K_3)
+            case S_Fall:
+                // Handle every press since last frame - short taps are not lost
+                for (int i = 0; int key = input.next_press(i);)
                 {
-                    return;
+                    if (key & K_3) return false;
+                    process_key(key);
                 }
                 if (timer.tick() && !figure.move(0, 1, 0))
                 {
-                    settle_down();
-                    squeeze();
-                    break;
+                    color_ff = true;
+                    countdown = settle_down_timeout;
+                    timer.reinit(level*settle_down_mult);
+                    figure.move(0, 0, 0, SC_2);
+                    state = S_Settle;
+                }
+                return true;
+
+            case S_Settle:
+                update_settle(input);
+                if (countdown > 0) return true;
+                figure.move(0, 0, 0, SC_2);
+                timer.reinit(level);
+                start_squeeze();
+                if (state == S_Squeeze) return true;
+                return new_figure();
+
+            case S_Squeeze:
+                if (!timer.tick()) return true;
+                if (++squeeze_step < squeeze_steps)
+                {
+                    squeeze_fill(squeeze_step);
+                    return true;
                 }
-            }
+                collapse();
+                return new_figure();
         }
+        return false;
+    }
+
+    uint32_t score() const override {return total_lines;}
+
+    void render(Pixels& dst) override
+    {
+        dst = field;
     }
 };
 
-// Retrun true if successfully placed
-bool TetrisGame::place_figure()
+// Retrun false if there is no room for new figure
+bool TetrisGame::new_figure()
 {
-    int sprite_idx = tetris_figures[get_random() % total_tetris_figures];
-    figure = Sprite(sprite_idx);
-    return figure.place(4, figure.spr().height/2, 0);
+    int sprite_idx = tetris_figures[random_below(total_tetris_figures)];
+    figure = Sprite(sprite_idx, field);
+    if (!figure.place(4, figure.spr().height/2, 0)) return false;
+    timer.reinit(level);
+    state = S_Fall;
+    return true;
 }
 
 void TetrisGame::process_key(int key)
@@ -75,92 +129,86 @@ void TetrisGame::process_key(int key)
     if (key & K_Down)  timer.reinit(level*fall_down_mult);
 }
 
-void TetrisGame::settle_down()
+// Figure blinks for 'settle_down_timeout' periods. Any move restarts countdown
+void TetrisGame::update_settle(const FrameInput& input)
 {
-    bool color_ff = true;
-    int countdown = settle_down_timeout;
-    
-    timer.reinit(level*settle_down_mult);
-    while (countdown > 0)
+    for (int i = 0; int key = input.next_press(i);)
     {
-        figure.move(0, 0, 0, color_ff ? SC_2 : SC_Full);        
-        auto key = read_key();
-        clr_keys(-1);
-        key &= ~K_Down;
-        if (key)
-        {
-            process_key(key);
-            while (figure.move(0, 1, 0)) {;} // Try to fall down
-            countdown = settle_down_timeout;
-        }
-        if (timer.tick())
-        {
-            color_ff = !color_ff;
-            --countdown;
-        }
+        if (key == K_Down) continue;
+        process_key(key);
+        while (figure.move(0, 1, 0)) {;} // Try to fall down
+        countdown = settle_down_timeout;
     }
-    figure.move(0, 0, 0, SC_2);
-    timer.reinit(level);
+    if (timer.tick())
+    {
+        color_ff = !color_ff;
+        --countdown;
+    }
+    if (countdown > 0) figure.move(0, 0, 0, color_ff ? SC_2 : SC_Full);
 }
 
-void TetrisGame::squeeze()
+void TetrisGame::start_squeeze()
 {
-    uint16_t squeeze_mask = 0;
+    TRACE_BEGIN(TP_Squeeze);
+    squeeze_mask = 0;
     for (int y = 0; y < 16; ++y)
     {
-        if (pixs.br2[y] == 0xFF) 
+        if (field.row_mask(y) == 0xFF) 
         {
             squeeze_mask |= 1 << y;
             ++collapsed_lines;
+            ++total_lines;
         }
     }
-    if (!squeeze_mask) return;
-    timer.reinit(level* squeeze_mult);
-
-    auto fill = [squeeze_mask](uint8_t c1, uint8_t c2) {
-        uint16_t m = squeeze_mask;
-        for (int y = 0; y < 16; ++y, m>>=1)
-        {
-            if (m & 1)
-            {
-                pixs.br1[y] = c1;
-                pixs.br2[y] = c2;
-            }
-        }
-    };
-    auto wait = [this]() {do { read_key(); } while(!timer.tick());};
+    if (squeeze_mask)
+    {
+        timer.reinit(level* squeeze_mult);
+        squeeze_step = 0;
+        squeeze_fill(0);
+        state = S_Squeeze;
+    }
+    TRACE_END(TP_Squeeze);
+}
 
-    for (int rep = 0; rep < squeeze_count; ++rep)
+// {Full -> 2/3 -> 1/3 -> 2/3} x squeeze_count -> Off
+void TetrisGame::squeeze_fill(int step)
+{
+    static const uint8_t colors[4][2] = {{0xFF, 0xFF}, {0, 0xFF}, {0xFF, 0}, {0, 0xFF}};
+    uint8_t c1 = 0, c2 = 0;
+    if (step < squeeze_steps - 1) {c1 = colors[step % 4][0]; c2 = colors[step % 4][1];}
+    uint16_t m = squeeze_mask;
+    for (int y = 0; y < 16; ++y, m>>=1)
     {
-        // {Full -> 2/3 -> 1/3 -> 2/3}
-        fill(0xFF, 0xFF); wait();
-        fill(0, 0xFF); wait();
-        fill(0xFF, 0); wait();
-        fill(0, 0xFF); wait();
+        if (m & 1) field.set_row(y, c1, c2);
     }
-    fill(0, 0); wait();
+}
+
+void TetrisGame::collapse()
+{
+    TRACE_BEGIN(TP_Squeeze);
     timer.reinit(level);
     int dst = 16;
     for (int y = 16; y--;)
     {
-        if (pixs.br1[y] | pixs.br2[y])
+        if (field.row_mask(y))
         {
             --dst;
-            if (dst != y) {pixs.br1[dst] = pixs.br1[y]; pixs.br2[dst] = pixs.br2[y];}
+            if (dst != y) field.copy_row(dst, y);
         }
     }
     while (dst--)
     {
-        pixs.br1[dst] = pixs.br2[dst] = 0;
+        field.set_row(dst, 0, 0);
     }
     if (collapsed_lines >= lines_per_level)
     {
         if (level < max_level) ++level;
         collapsed_lines -= lines_per_level;
     }
+    TRACE_END(TP_Squeeze);
 }
 
-void tetris_game()
+Game* create_tetris()
 {
-    TetrisGame().run();
+    return arena.create<TetrisGame>();
 }
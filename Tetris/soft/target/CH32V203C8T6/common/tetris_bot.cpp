@@ -0,0 +1,206 @@
+#include "game.h"
+#include "sprite.h"
+#include "spr_defs.h"
+#include "timeline.h"
+#include "arena.h"
+
+/*
+    Tetris autoplayer. Plays by picture only: falling figure is fully bright, settled blocks are dimmer (see 'TetrisGame').
+    For every new figure it tries all (rotation, x) placements on bitboard of settled blocks: figure is dropped straight
+    down from its current row and result is scored by cleared lines, holes, total height and bumpiness of columns.
+    Then figure is rotated and moved to best placement and dropped by K_Down.
+
+    Search is at most 4 rotations * 8 columns * (16 drop steps + scoring) of word operations. Its time is collected
+    by TP_BotSearch trace point and 'Autoplayer::search'.
+    Same shape may be in several figure groups (with different rotation order), so target is kept as shape,
+    not as sprite index.
+*/
+class TetrisBot : public Autoplayer {
+    // Heuristic weights (El-Tetris style, scaled to integers)
+    static constexpr int w_lines = 760;
+    static constexpr int w_height = -510;
+    static constexpr int w_holes = -356;
+    static constexpr int w_bumpiness = -184;
+
+    // Figure on screen
+    struct Figure {
+        int base;       // Sprite index of figure group (one of 'tetris_figures')
+        uint32_t shape; // Sprite pixels of current rotation
+        int x, y;       // Left top corner
+        int cx;         // Column of sprite center (x of 'Sprite::place')
+    };
+
+    Bitboard planned_board; // Settled blocks at last search
+    int planned_base;       // Figure of last search (0 - none)
+    uint32_t target_shape;  // Best placement: sprite pixels and center column
+    int target_cx;
+    uint8_t last_key;       // Key pressed at previous step
+    bool dropped;           // K_Down pressed for current plan
+    bool release;           // Game reacts on presses only, so keys are released every other frame
+
+    static bool find_figure(const Bitboard& full, Figure& fig);
+    static bool fits(const Bitboard& board, uint32_t shape, const SpriteDef& S, int x, int y);
+    static int evaluate(const Bitboard& board);
+    void plan(const Bitboard& board, const Figure& fig);
+
+public:
+    uint8_t keys(const Pixels& screen) override;
+};
+
+static int popcount8(uint8_t v)
+{
+    int result = 0;
+    for (; v; v &= v - 1) ++result;
+    return result;
+}
+
+// Fully lit pixels should form one of figures in any rotation
+bool TetrisBot::find_figure(const Bitboard& full, Figure& fig)
+{
+    int y = 0;
+    while (y < 16 && !full.row(y)) ++y;
+    if (y == 16) return false;
+    uint8_t cols = 0;
+    for (int i = y; i < 16; ++i)
+    {
+        if (i >= y + 4 && full.row(i)) return false;
+        cols |= full.row(i);
+    }
+    int x = 0;
+    while (!((cols >> x) & 1)) ++x;
+    uint32_t shape = 0;
+    for (int i = 0; i < 4 && y + i < 16; ++i) shape |= uint32_t(full.row(y + i) >> x) << (i * 8);
+
+    for (int f = 0; f < total_tetris_figures; ++f)
+    {
+        int base = tetris_figures[f];
+        for (int r = 0; r <= sprites[base].group_size; ++r)
+        {
+            const SpriteDef& S = sprites[base + r];
+            if (S.pixels != shape) continue;
+            fig = {base, shape, x, y, x + S.width / 2};
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sprite with left top corner at (x, y) is inside field and does not overlap 'board'
+bool TetrisBot::fits(const Bitboard& board, uint32_t shape, const SpriteDef& S, int x, int y)
+{
+    if (y + S.height > 16) return false;
+    uint64_t data = uint64_t(shape) << (y % 4 * 8 + x);
+    int w = y / 4;
+    uint32_t result = board.w[w] & uint32_t(data);
+    if (w < 3) result |= board.w[w + 1] & uint32_t(data >> 32);
+    return !result;
+}
+
+// Score of board after figure is placed (before full lines are removed)
+int TetrisBot::evaluate(const Bitboard& board)
+{
+    uint8_t rows[16];
+    int lines = 0;
+    int n = 16;
+    for (int y = 16; y--;)
+    {
+        uint8_t row = board.row(y);
+        if (row == 0xFF) ++lines; else rows[--n] = row;
+    }
+
+    int holes = 0, height = 0;
+    uint8_t heights[8] = {};
+    uint8_t covered = 0;
+    for (int y = n; y < 16; ++y)
+    {
+        uint8_t row = rows[y];
+        holes += popcount8(covered & ~row);
+        for (uint8_t top = row & ~covered; top; top &= top - 1)
+        {
+            int x = 0;
+            while (!((top >> x) & 1)) ++x;
+            heights[x] = 16 - y;
+            height += 16 - y;
+        }
+        covered |= row;
+    }
+    int bumpiness = 0;
+    for (int x = 0; x < 7; ++x) bumpiness += heights[x] > heights[x + 1] ? heights[x] - heights[x + 1] : heights[x + 1] - heights[x];
+
+    return w_lines * lines + w_height * height + w_holes * holes + w_bumpiness * bumpiness;
+}
+
+void TetrisBot::plan(const Bitboard& board, const Figure& fig)
+{
+    TRACE_BEGIN(TP_BotSearch);
+    uint32_t start = get_cycles();
+    planned_board = board;
+    planned_base = fig.base;
+    target_shape = fig.shape;
+    target_cx = fig.cx;
+    dropped = false;
+    int best = -0x7FFFFFFF;
+    for (int r = 0; r <= sprites[fig.base].group_size; ++r)
+    {
+        const SpriteDef& S = sprites[fig.base + r];
+        for (int x = 0; x + S.width <= 8; ++x)
+        {
+            int y = fig.y;
+            if (!fits(board, S.pixels, S, x, y)) continue;
+            while (fits(board, S.pixels, S, x, y + 1)) ++y;
+
+            Bitboard result = board;
+            uint64_t data = uint64_t(S.pixels) << (y % 4 * 8 + x);
+            result.w[y / 4] |= uint32_t(data);
+            if (y / 4 < 3) result.w[y / 4 + 1] |= uint32_t(data >> 32);
+
+            int value = evaluate(result);
+            if (value <= best) continue;
+            best = value;
+            target_shape = S.pixels;
+            target_cx = x + S.width / 2;
+        }
+    }
+    search.add(get_cycles() - start);
+    TRACE_END(TP_BotSearch);
+}
+
+uint8_t TetrisBot::keys(const Pixels& screen)
+{
+    Bitboard full, board;
+    for (int k = 0; k < 4; ++k)
+    {
+        uint32_t all = screen.planes[0].w[k], any = all;
+        for (int p = 1; p < bitplanes; ++p)
+        {
+            all &= screen.planes[p].w[k];
+            any |= screen.planes[p].w[k];
+        }
+        full.w[k] = all;
+        board.w[k] = any & ~all;
+    }
+
+    Figure fig;
+    if (release || !find_figure(full, fig))
+    {
+        release = false;
+        return 0;
+    }
+    if (fig.base != planned_base || memcmp(&board, &planned_board, sizeof(board))) plan(board, fig);
+
+    // Rotate first, but if rotation failed (no room yet) try to move meanwhile
+    uint8_t key = 0;
+    if (fig.shape != target_shape && last_key != K_Up) key = K_Up;
+    else if (fig.cx < target_cx) key = K_Right;
+    else if (fig.cx > target_cx) key = K_Left;
+    else if (fig.shape != target_shape) key = K_Up;
+    else if (!dropped) {key = K_Down; dropped = true;} // Faster fall is set once, next press would restart its timer
+    last_key = key;
+    release = key != 0;
+    return key;
+}
+
+Autoplayer* create_tetris_bot()
+{
+    return arena.create<TetrisBot>();
+}
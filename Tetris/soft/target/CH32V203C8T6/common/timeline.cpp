@@ -0,0 +1,57 @@
+#include <atomic>
+#include <stdio.h>
+
+#include "timeline.h"
+
+#if TIMELINE_SIZE
+
+struct TimelineRecord {
+    uint32_t time;
+    uint8_t id;
+    bool begin;
+};
+
+// Ring is per instance (per thread on host), so parallel games do not mix their records
+static INSTANCE_LOCAL TimelineRecord ring[TIMELINE_SIZE];
+static INSTANCE_LOCAL std::atomic<uint32_t> ring_pos{0}; // Total records written (slot is reserved atomically, so interrupts can trace too)
+
+void timeline_point(TracePoint id, bool begin)
+{
+    uint32_t time = get_cycles();
+    TimelineRecord& r = ring[ring_pos.fetch_add(1, std::memory_order_relaxed) & (TIMELINE_SIZE - 1)];
+    r.time = time;
+    r.id = id;
+    r.begin = begin;
+}
+
+void timeline_clear()
+{
+    ring_pos = 0;
+}
+
+void timeline_print()
+{
+    static const struct {const char* name; uint8_t isr;} points[] = {
+#define TIMELINE_INFO(id, name, isr) {name, isr},
+        TIMELINE_POINTS(TIMELINE_INFO)
+#undef TIMELINE_INFO
+    };
+
+    uint32_t end = ring_pos.load();
+    uint32_t start = end > TIMELINE_SIZE ? end - TIMELINE_SIZE : 0;
+    printf("TIMELINE %lu %lu\r\n", (unsigned long)(end - start), (unsigned long)cycles_per_us);
+    for(int i = 0; i < TP_Total; ++i) printf("P %d %d %s\r\n", i, points[i].isr, points[i].name);
+    for(uint32_t i = start; i != end; ++i)
+    {
+        const TimelineRecord& r = ring[i & (TIMELINE_SIZE - 1)];
+        printf("R %08lX %d %c\r\n", (unsigned long)r.time, r.id, r.begin ? 'B' : 'E');
+    }
+    printf("END\r\n");
+}
+
+#else
+
+void timeline_clear() {}
+void timeline_print() {}
+
+#endif
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "interface.h"
+
+/*
+    Timeline of hot path trace points (for profiling).
+    TRACE_BEGIN(id)/TRACE_END(id) write 'get_cycles' timestamp to RAM ring (last TIMELINE_SIZE records are kept).
+    Safe to use in interrupts. 'timeline_print' dumps ring as text (debug USART on device),
+    'scripts/timeline2json.py' converts dump to Chrome trace event JSON (chrome://tracing, ui.perfetto.dev).
+
+    Dump format:
+      TIMELINE <records> <cycles_per_us>
+      P <id> <is ISR: 0|1> <name>     - one per trace point
+      R <time, hex> <id> <B|E>        - records, oldest first
+      END
+*/
+
+// Ring is printed by platform ('trace_save') only when built with TIMELINE_DUMP=1. Otherwise trace points are compiled
+// out (TIMELINE_SIZE 0): no RAM and no ring writes for records nobody reads. Host build sets TIMELINE_SIZE itself
+#ifndef TIMELINE_DUMP
+#define TIMELINE_DUMP 0
+#endif
+
+#ifndef TIMELINE_SIZE
+#define TIMELINE_SIZE (TIMELINE_DUMP ? 256 : 0) // Records in ring (power of 2), 0 - trace points disabled
+#endif
+
+static_assert((TIMELINE_SIZE & (TIMELINE_SIZE - 1)) == 0, "TIMELINE_SIZE should be power of 2");
+
+// Trace points: id, name, is interrupt handler
+#define TIMELINE_POINTS(X) \
+    X(TP_FrameIsr,      "frame_isr",    1) \
+    X(TP_Present,       "present",      0) \
+    X(TP_GameUpdate,    "game_update",  0) \
+    X(TP_GameRender,    "game_render",  0) \
+    X(TP_Squeeze,       "squeeze",      0) \
+    X(TP_MenuScroll,    "menu_scroll",  0) \
+    X(TP_BotSearch,     "bot_search",   0)
+
+enum TracePoint : uint8_t {
+#define TIMELINE_ENUM(id, name, isr) id,
+    TIMELINE_POINTS(TIMELINE_ENUM)
+#undef TIMELINE_ENUM
+    TP_Total
+};
+
+#if TIMELINE_SIZE
+void timeline_point(TracePoint id, bool begin);
+#define TRACE_BEGIN(id) timeline_point(id, true)
+#define TRACE_END(id) timeline_point(id, false)
+#else
+#define TRACE_BEGIN(id) ((void)0)
+#define TRACE_END(id) ((void)0)
+#endif
+
+void timeline_clear();
+void timeline_print();  // Dump ring by 'printf' (see format above)
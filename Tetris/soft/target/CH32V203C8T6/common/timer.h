@@ -39,7 +39,7 @@ public:
     {
         for(;;)
         {
-            read_key();
+            next_frame();
             if (tick()) return;
         }
     }
@@ -3,38 +3,39 @@
 #include "spr_defs.h"
 #include "sprite.h"
 #include "timer.h"
+#include "trace.h"
+#include "arena.h"
+#include "game.h"
+#include "timeline.h"
+#include "scheduler.h"
+#include "isr_stats.h"
+#include "vscreen.h"
 
 
 static constexpr int scroll_mul = 2;
+static constexpr int scroll_hor_period = 1000 / (6 * scroll_mul) / tick_time;  // Frames per pixel of logo slide
+static constexpr int scroll_ver_period = 1000 / (14 * scroll_mul) / tick_time;
 
-void tetris_game();
-void snake_game();
-void invation_game();
+Game* create_tetris();
+Game* create_snake();
+Game* create_invation();
+Autoplayer* create_tetris_bot();
+Autoplayer* create_snake_bot();
 
+const GameInfo games[] = {
+    {"tetris", 0, create_tetris, create_tetris_bot},
+    {"snake", 1, create_snake, create_snake_bot},
+    {"invation", 2, create_invation, nullptr},
+};
+const int total_games = sizeof(games) / sizeof(games[0]);
 
-// Mix <bits_first> of 'icon1' with 'icon2'
-//  icon1  icon2
-//  0    5 0    5 < bit number
-//  ****** ******
-//    +------+  << window
-//  <->         << bits_first
-static void hor_mix(int icon1, int icon2, uint8_t bits_first)
-{
-    const uint8_t* p1 = logos + icon1 * 28;
-    const uint8_t* p2 = logos + icon2 * 28;
+static_assert(sizeof(games) / sizeof(games[0]) <= total_logos, "Every game should have logo");
 
-    uint8_t mask2 = (1 << bits_first) - 1;
-    uint8_t shift2 = 6 - bits_first;
+INSTANCE_LOCAL FrameStats game_stats[total_games];
+
+static constexpr uint32_t max_catch_up = 4; // Max updates per displayed frame (if game loop is late)
+static constexpr uint32_t attract_timeout = 20000 / tick_time; // Frames without keys in menu before game demo
 
-    auto action = [=](const uint8_t* src1, const uint8_t* src2, uint8_t* dst)
-        {
-            *dst++ = 0xFF;
-            for(int i=0; i<14; ++i) *dst++ = (((*src1++ >> bits_first) | ((*src2++ & mask2) << shift2)) << 1) | 0x81;
-            *dst++ = 0xFF;
-        };
-    action(p1, p2, pixs.br1);
-    action(p1+14, p2+14, pixs.br2);
-}
 
 // Mix 'lines_first' of icon1 with icon2 (lines_first is a number of lines to skip)
 static void ver_mix(int icon1, int icon2, uint8_t lines_first)
@@ -42,96 +43,137 @@ static void ver_mix(int icon1, int icon2, uint8_t lines_first)
     const uint8_t* p1 = logos + icon1 * 28 + lines_first;
     const uint8_t* p2 = logos + icon2 * 28;
 
-    auto action = [=](const uint8_t* src1, const uint8_t* src2, uint8_t* dst)
+    auto put = [](int y, const uint8_t* src)
         {
-            *dst++ = 0xFF;
-            for (int i = lines_first; i < 14; ++i) *dst++ = (*src1++ << 1) | 0x81;
-            for (int i = 0; i < lines_first; ++i) *dst++ = (*src2++ << 1) | 0x81;
-            *dst++ = 0xFF;
+            pixs.set_row(y, (src[0] << 1) | 0x81, (src[14] << 1) | 0x81);
         };
-    action(p1, p2, pixs.br1);
-    action(p1 + 14, p2 + 14, pixs.br2);
+    int y = 0;
+    pixs.set_row(y++, 0xFF, 0xFF);
+    for (int i = lines_first; i < 14; ++i) put(y++, p1++);
+    for (int i = 0; i < lines_first; ++i) put(y++, p2++);
+    pixs.set_row(y, 0xFF, 0xFF);
 }
 
-inline void draw_icon(int icon) {ver_mix(logos_entries[icon], logos_entries[icon], 0);}
+inline void draw_icon(int game) {ver_mix(logos_entries[games[game].logo], logos_entries[games[game].logo], 0);}
 
-static int scroll_hor(int icon, int delta)
+// Draw framed 'icon' (same picture as 'draw_icon') on virtual screen with left top corner at (x, y)
+static void put_icon(int icon, int x, int y)
 {
-    Timer t(6 * scroll_mul);
-    int result = (icon + delta + LogosTotal) % LogosTotal;
-    int icon2 = logos_entries[result];
-    icon = logos_entries[icon];
-    if (delta > 0)
-    {
-        for (int i = 0; i < 7; ++i)
-        {
-            hor_mix(icon, icon2, i);
-            t.wait();
-        }
-    }
-    else
-    {
-        for (int i = 0; i < 7; ++i)
-        {
-            hor_mix(icon2, icon, 6 - i);
-            t.wait();
-        }
-    }
+    const uint8_t* p = logos + icon * 28;
+    vscreen.set_row8(x, y, 0xFF, 0xFF);
+    for(int i=0; i<14; ++i) vscreen.set_row8(x, y+i+1, (p[i] << 1) | 0x81, (p[i+14] << 1) | 0x81);
+    vscreen.set_row8(x, y+15, 0xFF, 0xFF);
+}
+
+// Slide from current game logo to next one, which comes from (dx, dy) side. Both are drawn once on virtual screen,
+// then viewport pans by itself (see 'vscreen.h'), so main loop only waits for frames
+static int scroll(int game, int delta, int dx, int dy, int period)
+{
+    int result = (game + delta + total_games) % total_games;
+    TRACE_BEGIN(TP_MenuScroll);
+    put_icon(logos_entries[games[game].logo], 0, 0);
+    put_icon(logos_entries[games[result].logo], dx & (vscreen_width - 1), dy & (vscreen_height - 1));
+    vscreen_show(0, 0);
+    vscreen_pan(dx, dy, period);
+    TRACE_END(TP_MenuScroll);
+    while (vscreen_panning()) next_frame();
+    vscreen_hide();
     return result;
 }
 
-static int scroll_ver(int icon, int delta)
+static int scroll_hor(int game, int delta) {return scroll(game, delta, delta > 0 ? 8 : -8, 0, scroll_hor_period);}
+static int scroll_ver(int game, int delta) {return scroll(game, delta, 0, delta > 0 ? 16 : -16, scroll_ver_period);}
+
+static constexpr uint8_t isr_stats_combo = K_2 | K_3; // Hold in menu to show interrupts statistics
+static constexpr uint8_t idle_timeout = 0; // 'update_icon' result: no keys for 'attract_timeout' frames
+
+static void freeze()
 {
-    Timer t(14 * scroll_mul);
-    int result = (icon + delta + LogosTotal) % LogosTotal;
-    int icon2 = logos_entries[result];
-    icon = logos_entries[icon];
-    if (delta > 0)
+    for (int y = 0; y < 16; ++y)
     {
-        for (int i = 0; i < 15; ++i)
-        {
-            ver_mix(icon, icon2, i);
-            t.wait();
-        }
+        pixs.set_row(y, pixs.row_mask(y), 0);
     }
-    else
+}
+
+static constexpr int logo_frame_ticks = 1000 / (4 * tick_time); // Logo animation: 4 pictures per second
+
+// Menu background jobs. Run by 'next_frame' (see 'scheduler.h') while 'update_icon' waits for keys
+
+// Cycle pictures of animated logo
+struct LogoAnimation : Task {
+    uint8_t start_idx, end_idx; // Pictures of logo (indexes in 'logos')
+    uint8_t ico;
+
+    LogoAnimation() : Task(body) {}
+
+    static void body(Task& task)
     {
-        for (int i = 0; i < 15; ++i)
+        auto& self = static_cast<LogoAnimation&>(task);
+        TASK_BEGIN(task);
+        for(self.ico = self.start_idx;;)
         {
-            ver_mix(icon2, icon, 14 - i);
-            t.wait();
+            TASK_AWAIT_TICKS(task, logo_frame_ticks);
+            ver_mix(self.ico, self.ico, 0);
+            if (++self.ico >= self.end_idx) self.ico = self.start_idx;
         }
+        TASK_END(task);
     }
-    return result;
-}
+};
 
-static void freeze()
-{
-    for (int y = 0; y < 16; ++y)
+// Set 'held' when all keys of 'combo' are pressed together (checked on every key event)
+struct ComboWatch : Task {
+    uint8_t combo;
+    bool held;
+
+    explicit ComboWatch(uint8_t combo) : Task(body), combo(combo), held(false) {}
+
+    static void body(Task& task)
     {
-        pixs.br1[y] |= pixs.br2[y];
-        pixs.br2[y] = 0;
+        auto& self = static_cast<ComboWatch&>(task);
+        TASK_BEGIN(task);
+        for(;;)
+        {
+            TASK_AWAIT_KEY(task);
+            if ((pressed_keys() & self.combo) == self.combo) self.held = true;
+        }
+        TASK_END(task);
     }
-}
+};
+
+static INSTANCE_LOCAL LogoAnimation logo_animation;
+static INSTANCE_LOCAL ComboWatch isr_stats_watch(isr_stats_combo);
 
 static uint8_t update_icon(int game)
 {
-    Timer t(4);
-    uint8_t start_idx = logos_entries[game];
-    uint8_t end_idx = logos_entries[game+1];
-    uint8_t ico = start_idx;
-    for (;;)
+    logo_animation.start_idx = logos_entries[games[game].logo];
+    logo_animation.end_idx = logos_entries[games[game].logo+1];
+    task_start(logo_animation);
+    isr_stats_watch.held = false;
+    task_start(isr_stats_watch);
+
+    uint8_t result = idle_timeout;
+    for (uint32_t idle = 0;; ++idle)
     {
-        auto key = read_key();
+        auto key = next_frame();
         clr_keys(-1);
-        if (key & (K_Up|K_Down|K_Left|K_Right|K_Hit)) return key;
-        if (t.tick())
-        {
-            ver_mix(ico, ico, 0);
-            ++ico;
-            if (ico >= end_idx) ico = start_idx;
-        }
+        if (isr_stats_watch.held) {result = isr_stats_combo; break;}
+        if (key & (K_Up|K_Down|K_Left|K_Right|K_Hit)) {result = key; break;}
+        if (key) idle = 0;
+        if (idle >= attract_timeout && games[game].create_bot) break;
     }
+    task_stop(logo_animation);
+    task_stop(isr_stats_watch);
+    return result;
+}
+
+// Attract mode: game is played by its autoplayer until game over or any key press
+static void run_demo(int game)
+{
+    ArenaScope scope;
+    Autoplayer* bot = games[game].create_bot();
+    pixs.clear();
+    run_game(game, bot);
+    clr_keys(-1);
 }
 
 static void select_game(int& game)
@@ -148,6 +190,8 @@ static void select_game(int& game)
             case K_Right: game = scroll_hor(game, -1); break;
             case K_Left:  game = scroll_hor(game, 1); break;
             case K_Hit: return;
+            case isr_stats_combo: show_isr_stats(); break;
+            case idle_timeout: run_demo(game); break;
         }
         draw_icon(game);
     }
@@ -157,7 +201,7 @@ static bool rd_key()
 {
     for(;;)
     {
-        auto key = read_key();
+        auto key = next_frame();
         clr_keys(-1);
         if (key & K_1) return false;
         if (key & K_2) return true;
@@ -165,6 +209,63 @@ static bool rd_key()
 
 }
 
+// Replace player input by autoplayer keys ('held' - keys returned last time).
+// Returns false if player pressed any key (demo is over)
+static bool bot_input(Autoplayer& bot, uint8_t& held, FrameInput& input)
+{
+    int idx = 0;
+    if (input.next_press(idx)) return false;
+    uint8_t keys = bot.keys(pixs);
+    uint8_t changed = keys ^ held;
+    held = keys;
+    input.keys = keys;
+    input.total_events = 0;
+    for (uint8_t key = 1; key; key <<= 1)
+    {
+        if (changed & key) input.events[input.total_events++] = {uint16_t(trace_frame()), key, (keys & key) != 0};
+    }
+    return true;
+}
+
+// Fixed timestep game loop: one 'update' per frame (extra updates to catch up if loop was late),
+// 'render' and 'present' once per displayed frame, sleep till frame boundary
+uint32_t run_game(int game, Autoplayer* bot)
+{
+    ArenaScope scope; // Game memory is released on exit
+    Game* g = games[game].create();
+    FrameStats& stats = game_stats[game];
+    FrameInput input;
+    uint8_t bot_keys = 0;
+    g->render(pixs);
+    for (;;)
+    {
+        TRACE_BEGIN(TP_Present);
+        present();
+        TRACE_END(TP_Present);
+        uint32_t frames = wait_vsync();
+        if (frames > max_catch_up) frames = max_catch_up;
+        stats.missed += frames - 1;
+        uint32_t start = get_cycles();
+        while (frames--)
+        {
+            read_frame_input(input);
+            if (bot && !bot_input(*bot, bot_keys, input)) return g->score();
+            TRACE_BEGIN(TP_GameUpdate);
+            bool running = g->update(input);
+            TRACE_END(TP_GameUpdate);
+            if (!running)
+            {
+                g->render(pixs);
+                return g->score();
+            }
+        }
+        TRACE_BEGIN(TP_GameRender);
+        g->render(pixs);
+        TRACE_END(TP_GameRender);
+        stats.add(get_cycles() - start);
+    }
+}
+
 void entry()
 {
     int game=0;
@@ -175,12 +276,9 @@ void entry()
         for(;;)
         {
             pixs.clear();
-            switch (game)
-            {
-                case Logo_tetris: tetris_game(); break;
-                case Logo_snake: snake_game(); break;
-                case Logo_invation: invation_game(); break;
-            }
+            trace_begin(game);
+            run_game(game);
+            trace_end();
             freeze();
             if (rd_key()) break;
         }
@@ -0,0 +1,151 @@
+#include "trace.h"
+#include "key_queue.h"
+
+enum class TraceMode : uint8_t {
+    Off,
+    Record,
+    Replay
+};
+
+static INSTANCE_LOCAL TraceMode mode;
+#if TRACE_BUFFER_SIZE
+static INSTANCE_LOCAL uint8_t buffer[TRACE_BUFFER_SIZE]; // Recorded trace
+static INSTANCE_LOCAL bool overflow;                     // Buffer is full, rest of events are lost
+#endif
+static INSTANCE_LOCAL const uint8_t* data;               // Trace data (recorded or replayed)
+static INSTANCE_LOCAL uint32_t data_size;                // Size of replayed data
+static INSTANCE_LOCAL uint32_t pos;                      // Write (record) or read (replay) position
+static INSTANCE_LOCAL uint32_t frame;                    // Frames since game start
+static INSTANCE_LOCAL uint32_t last_frame;               // Frame of last record
+static INSTANCE_LOCAL uint32_t next_at;                  // Frame of next replayed record
+static INSTANCE_LOCAL uint8_t keys;                      // Physical keys state (as seen by game)
+
+#if TRACE_BUFFER_SIZE
+static void put_u32(uint8_t* dst, uint32_t value)
+{
+    for(int i=0; i<4; ++i, value >>= 8) dst[i] = value;
+}
+#endif
+
+static uint32_t get_u32(const uint8_t* src)
+{
+    return src[0] | (src[1] << 8) | (src[2] << 16) | (uint32_t(src[3]) << 24);
+}
+
+void trace_begin(int game)
+{
+    uint32_t seed = get_entropy();
+    seed_random(seed);
+    uint8_t active = read_key(); // Consume pending events first: they update 'keys' too
+#if TRACE_BUFFER_SIZE
+    buffer[0] = 'R'; buffer[1] = 'W'; buffer[2] = 'T'; buffer[3] = '2';
+    buffer[4] = game;
+    buffer[5] = keys;
+    buffer[6] = active;
+    buffer[7] = 0;
+    put_u32(buffer+8, seed);
+    put_u32(buffer+12, 0);
+    data = buffer;
+    pos = trace_header_size;
+    frame = last_frame = 0;
+    overflow = false;
+    mode = TraceMode::Record;
+#else
+    (void)game;
+    (void)active;
+#endif
+}
+
+void trace_end()
+{
+#if TRACE_BUFFER_SIZE
+    if (mode == TraceMode::Record)
+    {
+        if (!overflow) put_u32(buffer+12, frame);
+        trace_save(buffer, pos);
+    }
+#endif
+    mode = TraceMode::Off;
+}
+
+// Fetch frame of next record
+static void replay_next()
+{
+    next_at = uint32_t(-1);
+    uint32_t delta = 0;
+    for(int shift = 0; pos < data_size; shift += 7)
+    {
+        uint8_t b = data[pos++];
+        delta |= uint32_t(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            if (pos < data_size) next_at = last_frame + delta;
+            return;
+        }
+    }
+}
+
+// Push events of current frame to key queue
+static void replay_frame()
+{
+    while (next_at == frame)
+    {
+        uint8_t new_keys = data[pos++];
+        uint8_t changed = keys ^ new_keys;
+        for(uint8_t key = 1; key; key <<= 1)
+        {
+            if (changed & key) key_queue.put({uint16_t(frame), key, (new_keys & key) != 0});
+        }
+        keys = new_keys;
+        last_frame = frame;
+        replay_next();
+    }
+}
+
+int trace_replay(const uint8_t* trace, uint32_t size)
+{
+    if (size < trace_header_size || trace[0] != 'R' || trace[1] != 'W' || trace[2] != 'T' || trace[3] != '2') return -1;
+    data = trace;
+    data_size = size;
+    pos = trace_header_size;
+    frame = last_frame = 0;
+    keys = trace[5];
+    restore_keys(trace[6]);
+    seed_random(get_u32(trace+8));
+    mode = TraceMode::Replay;
+    replay_next();
+    replay_frame();
+    return trace[4];
+}
+
+bool trace_active() {return mode != TraceMode::Off;}
+
+uint32_t trace_frame() {return frame;}
+
+uint32_t trace_total_frames()
+{
+    return mode == TraceMode::Replay ? get_u32(data+12) : 0;
+}
+
+void trace_next_frame()
+{
+    ++frame;
+    if (mode == TraceMode::Replay) replay_frame();
+}
+
+void trace_key(const KeyEvent& event)
+{
+    if (mode == TraceMode::Replay) return;
+    if (event.press) keys |= event.key; else keys &= ~event.key;
+#if TRACE_BUFFER_SIZE
+    if (mode != TraceMode::Record || overflow) return;
+    if (pos + 6 > sizeof(buffer)) {overflow = true; return;}
+    for(uint32_t delta = frame - last_frame;; delta >>= 7)
+    {
+        if (delta < 0x80) {buffer[pos++] = delta; break;}
+        buffer[pos++] = (delta & 0x7F) | 0x80;
+    }
+    buffer[pos++] = keys;
+    last_frame = frame;
+#endif
+}
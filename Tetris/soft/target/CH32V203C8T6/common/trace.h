@@ -0,0 +1,50 @@
+#pragma once
+
+#include "interface.h"
+
+/*
+    Input trace. Allows to replay game session bit-exactly: same keys at same frames and same random numbers.
+    Frame is number of 'next_frame' calls since game start. Keys are recorded when consumed by game,
+    so replay does not depend on timing of platform.
+
+    Binary format (little endian):
+      Header (16 bytes):
+        'R','W','T','2' (version 2 - xoshiro128** random)
+        uint8_t  game (index in 'games' registry)
+        uint8_t  keys pressed at start
+        uint8_t  keys active at start (see 'clr_keys')
+        uint8_t  reserved
+        uint32_t random seed
+        uint32_t total frames of game (0 - unknown, trace was truncated)
+      Records (one per key event):
+        frames since previous record (LEB128), uint8_t keys pressed after event
+*/
+
+// Platform saves finished traces ('trace_save') only when built with TRACE_DUMP=1. Otherwise recording is compiled out
+// (TRACE_BUFFER_SIZE 0): no RAM is spent on buffer nobody reads. Replay does not need the buffer
+#ifndef TRACE_DUMP
+#define TRACE_DUMP 0
+#endif
+
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE (TRACE_DUMP ? 4096 : 0)
+#endif
+
+static constexpr int trace_header_size = 16;
+
+void trace_begin(int game); // Game start. Seed random from platform entropy and start recording (if compiled in)
+void trace_end();           // Game end. Finish recording (or replay) and pass trace to platform ('trace_save')
+
+// Start replay of trace (use instead of 'trace_begin'). Returns game to run or -1 if trace is not valid
+int trace_replay(const uint8_t* data, uint32_t size);
+
+bool trace_active();           // Trace recorded or replayed (random should not be reseeded)
+uint32_t trace_frame();        // Frames since game start
+uint32_t trace_total_frames(); // Total frames of replayed game (0 - unknown)
+
+// Hooks for common code
+void trace_next_frame();                // Called by 'next_frame'
+void trace_key(const KeyEvent& event);  // Called for every consumed key event
+
+// Implemented by platform. Save finished trace
+void trace_save(const uint8_t* data, uint32_t size);
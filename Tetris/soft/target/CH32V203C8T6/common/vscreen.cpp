@@ -0,0 +1,89 @@
+#include "vscreen.h"
+
+INSTANCE_LOCAL VScreen vscreen;
+
+// Viewport registers. Written by main loop, read and advanced by platform at frame boundary (frame interrupt on
+// device). 'vscreen_show' drops 'shown' while position is changed, so frame boundary never sees half of it.
+// Pan state is one word, so 'vscreen_pan' publishes it by single store while viewport is shown
+struct Pan {
+    int8_t dx, dy;          // Steps left (sign - direction)
+    uint8_t period;         // Frames per step
+    uint8_t countdown;      // Frames till next step
+};
+static_assert(sizeof(Pan) == sizeof(uint32_t), "Pan should fit in one word");
+
+static uint32_t pack(const Pan& pan) {uint32_t result; memcpy(&result, &pan, sizeof(result)); return result;}
+static Pan unpack(uint32_t word) {Pan result; memcpy(&result, &word, sizeof(result)); return result;}
+
+struct Viewport {
+    uint8_t x, y;           // Left top corner
+    uint32_t pan;           // Packed 'Pan'
+    bool shown;
+    bool changed;           // Window should be recomposed
+};
+
+static INSTANCE_LOCAL volatile Viewport viewport;
+
+void vscreen_show(int x, int y)
+{
+    viewport.shown = false;
+    viewport.x = x & (vscreen_width - 1);
+    viewport.y = y & (vscreen_height - 1);
+    viewport.pan = 0;
+    viewport.changed = true;
+    viewport.shown = true;
+}
+
+void vscreen_pan(int dx, int dy, int period)
+{
+    if (period < 1) period = 1;
+    viewport.pan = pack({int8_t(dx), int8_t(dy), uint8_t(period), uint8_t(period)});
+}
+
+bool vscreen_panning()
+{
+    Pan pan = unpack(viewport.pan);
+    return pan.dx || pan.dy;
+}
+void vscreen_hide() {viewport.shown = false;}
+bool vscreen_shown() {return viewport.shown;}
+
+bool vscreen_frame(Pixels& dst)
+{
+    Pan pan = unpack(viewport.pan);
+    if (pan.dx || pan.dy)
+    {
+        if (!--pan.countdown)
+        {
+            pan.countdown = pan.period;
+            if (pan.dx)
+            {
+                int step = pan.dx > 0 ? 1 : -1;
+                viewport.x = (viewport.x + step) & (vscreen_width - 1);
+                pan.dx -= step;
+            }
+            if (pan.dy)
+            {
+                int step = pan.dy > 0 ? 1 : -1;
+                viewport.y = (viewport.y + step) & (vscreen_height - 1);
+                pan.dy -= step;
+            }
+            viewport.changed = true;
+        }
+        viewport.pan = pack(pan); // Main loop can't run in between ('vscreen_frame' is called at frame boundary)
+    }
+    if (!viewport.changed) return false;
+    viewport.changed = false;
+
+    // Row is doubled, so window wrapped over right edge is taken by one shift
+    int x = viewport.x, y = viewport.y;
+    for(int p = 0; p < bitplanes; ++p)
+    {
+        for(int i = 0; i < 16; ++i)
+        {
+            uint32_t row = vscreen.br[p][(y + i) & (vscreen_height - 1)];
+            dst.br[p][i] = uint8_t((row | (row << vscreen_width)) >> x);
+        }
+    }
+    return true;
+}
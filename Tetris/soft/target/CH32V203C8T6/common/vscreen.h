@@ -0,0 +1,64 @@
+#pragma once
+
+#include "interface.h"
+
+/*
+    Virtual screen: picture bigger than LED matrix, shown through 8x16 viewport.
+    Viewport position is kept in registers applied by platform at frame boundary (on device - by frame interrupt, which
+    rebuilds scan frame from viewport window). Viewport can also pan by itself, one pixel per given number of frames.
+    So scrolling costs nothing in main loop: draw 'vscreen' once, start pan and just wait for frames.
+
+    Coordinates wrap around (x modulo 'vscreen_width', y modulo 'vscreen_height'). So endless marquee only has to draw
+    next columns in hidden part of 'vscreen' before they come into view.
+    Window is recomposed when viewport moves only, so draw visible part before 'vscreen_show'.
+
+    While virtual screen is shown, 'present()' is ignored. After 'vscreen_hide()' picture of 'pixs' is shown again
+    (from next 'present()').
+
+How to use:
+
+    vscreen.clear();
+    vscreen.set_row8(0, y, c1, c2);     // Current picture at left
+    vscreen.set_row8(8, y, c1, c2);     // Next one at right
+    vscreen_show(0, 0);
+    vscreen_pan(8, 0, 5);               // Slide to next picture, one pixel per 5 frames
+    while (vscreen_panning()) next_frame();
+    vscreen_hide();
+*/
+
+static constexpr int vscreen_width = 16;
+static constexpr int vscreen_height = 32;
+
+struct VScreen {
+    uint16_t br[bitplanes][vscreen_height]; // Bitplanes, as in 'Pixels'. Bit X of br[p][Y] - pixel (X,Y)
+
+    // Put 8 pixels (x..x+7) of row 'y' in 2-plane format (see 'Pixels::set_row'). Coordinates wrap around
+    void set_row8(int x, int y, uint8_t c1, uint8_t c2)
+    {
+        x &= vscreen_width - 1;
+        y &= vscreen_height - 1;
+        uint16_t mask = rotate(0xFF, x);
+        for(int p = 0; p < bitplanes; ++p)
+        {
+            br[p][y] = (br[p][y] & ~mask) | rotate(Pixels::plane_bits<uint8_t>(p, c1, c2), x);
+        }
+    }
+    void clear() {memset(this, 0, sizeof(*this));}
+
+private:
+    static uint16_t rotate(uint8_t bits, int x) {return uint16_t((uint32_t(bits) << x) | (uint32_t(bits) >> (vscreen_width - x)));}
+};
+
+extern INSTANCE_LOCAL VScreen vscreen;
+
+void vscreen_show(int x, int y);               // Show 'vscreen' from next frame, left top corner of viewport at (x, y)
+void vscreen_pan(int dx, int dy, int period);  // Move viewport by (dx, dy) pixels (up to 127), one step per 'period' frames (up to 255)
+bool vscreen_panning();                        // Viewport is still moving
+void vscreen_hide();                           // Return to 'pixs'
+
+//////////////////////////////
+// Platform side
+bool vscreen_shown();
+// Called at every frame boundary while virtual screen is shown: makes pan step and puts viewport window to 'dst'.
+// Returns false (and leaves 'dst' untouched) if window is the same as at previous call
+bool vscreen_frame(Pixels& dst);